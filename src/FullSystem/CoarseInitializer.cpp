@@ -64,6 +64,7 @@ CoarseInitializer::CoarseInitializer(int ww, int hh) : thisToNext_aff(0,0), this
 	frameID=-1;
 	fixAffine=true;
 	printDebug=false;
+	firstFrame=newFrame=0;
 
 	wM.diagonal()[0] = wM.diagonal()[1] = wM.diagonal()[2] = SCALE_XI_ROT;
 	wM.diagonal()[3] = wM.diagonal()[4] = wM.diagonal()[5] = SCALE_XI_TRANS;
@@ -82,6 +83,22 @@ CoarseInitializer::~CoarseInitializer()
 	delete[] JbBuffer_new;
 }
 
+void CoarseInitializer::reset()
+{
+	for(int lvl=0; lvl<pyrLevelsUsed; lvl++)
+	{
+		if(points[lvl] != 0) delete[] points[lvl];
+		points[lvl] = 0;
+		numPoints[lvl] = 0;
+	}
+
+	frameID=-1;
+	fixAffine=true;
+	firstFrame=newFrame=0;
+	thisToNext_aff = AffLight(0,0);
+	thisToNext = SE3();
+}
+
 
 
 void CoarseInitializer::setFirst(CalibHessian* HCalib, FrameHessian* newFrameHessian, cv::Mat depth)
@@ -30,7 +30,7 @@
 #include "util/settings.h"
 #include "vector"
 #include <math.h>
-#include <monodepth2/monodepth.h>
+#include <opencv2/core/core.hpp>
 
 
 
@@ -86,6 +86,9 @@ public:
 
 	void setFirst(CalibHessian* HCalib, FrameHessian* newFrameHessian, cv::Mat depthmap);
 
+	// back to the state before setFirst(). does not delete firstFrame.
+	void reset();
+
 	int frameID;
 	bool fixAffine;
 	bool printDebug;
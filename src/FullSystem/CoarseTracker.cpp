@@ -30,6 +30,7 @@
  */
 
 #include "FullSystem/CoarseTracker.h"
+#include "FullSystem/CoarseTrackerKernels.h"
 #include "FullSystem/FullSystem.h"
 #include "FullSystem/HessianBlocks.h"
 #include "FullSystem/Residuals.h"
@@ -76,14 +77,8 @@ CoarseTracker::CoarseTracker(int ww, int hh) : lastRef_aff_g2l(0,0)
 	}
 
 	// warped buffers
-    buf_warped_idepth = allocAligned<4,float>(ww*hh, ptrToDelete);
-    buf_warped_u = allocAligned<4,float>(ww*hh, ptrToDelete);
-    buf_warped_v = allocAligned<4,float>(ww*hh, ptrToDelete);
-    buf_warped_dx = allocAligned<4,float>(ww*hh, ptrToDelete);
-    buf_warped_dy = allocAligned<4,float>(ww*hh, ptrToDelete);
-    buf_warped_residual = allocAligned<4,float>(ww*hh, ptrToDelete);
-    buf_warped_weight = allocAligned<4,float>(ww*hh, ptrToDelete);
-    buf_warped_refColor = allocAligned<4,float>(ww*hh, ptrToDelete);
+	scratchSize = ww*hh;
+	scratch.push_back(makeScratch());
 
 
 	newFrame = 0;
@@ -97,6 +92,43 @@ CoarseTracker::~CoarseTracker()
     for(float* ptr : ptrToDelete)
         delete[] ptr;
     ptrToDelete.clear();
+    for(CoarseTrackerScratch* s : scratch)
+        delete s;
+}
+
+CoarseTrackerScratch* CoarseTracker::makeScratch()
+{
+	CoarseTrackerScratch* s = new CoarseTrackerScratch();
+    s->buf_warped_idepth = 0;
+    s->buf_warped_u = 0;
+    s->buf_warped_v = 0;
+    s->buf_warped_dx = 0;
+    s->buf_warped_dy = 0;
+    s->buf_warped_residual = 0;
+    s->buf_warped_weight = 0;
+    s->buf_warped_refColor = 0;
+    s->buf_warped_n = 0;
+	return s;
+}
+
+void CoarseTracker::makeWarpedBuffers(CoarseTrackerScratch &s)
+{
+    s.buf_warped_idepth = allocAligned<4,float>(scratchSize, ptrToDelete);
+    s.buf_warped_u = allocAligned<4,float>(scratchSize, ptrToDelete);
+    s.buf_warped_v = allocAligned<4,float>(scratchSize, ptrToDelete);
+    s.buf_warped_dx = allocAligned<4,float>(scratchSize, ptrToDelete);
+    s.buf_warped_dy = allocAligned<4,float>(scratchSize, ptrToDelete);
+    s.buf_warped_residual = allocAligned<4,float>(scratchSize, ptrToDelete);
+    s.buf_warped_weight = allocAligned<4,float>(scratchSize, ptrToDelete);
+    s.buf_warped_refColor = allocAligned<4,float>(scratchSize, ptrToDelete);
+}
+
+void CoarseTracker::reset()
+{
+	newFrame = 0;
+	lastRef = 0;
+	lastRef_aff_g2l = AffLight(0,0);
+	refFrameID=-1;
 }
 
 void CoarseTracker::makeK(CalibHessian* HCalib)
@@ -443,8 +475,43 @@ void CoarseTracker::makeCoarseDepthL0(std::vector<FrameHessian*> frameHessians)
 
 
 
-void CoarseTracker::calcGSSSE(int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l)
+// Accumulator9::updateSSE_eighted with the Jacobian of 4 warped points.
+static inline void accumulateWarpedSSE(Accumulator9 &acc,
+		const float* idepth, const float* u_, const float* v_, const float* dx_, const float* dy_,
+		const float* residual, const float* weight, const float* refColor,
+		__m128 fxl, __m128 fyl, __m128 a, __m128 b0)
+{
+	__m128 one = _mm_set1_ps(1);
+	__m128 minusOne = _mm_set1_ps(-1);
+	__m128 zero = _mm_set1_ps(0);
+
+	__m128 dx = _mm_mul_ps(_mm_load_ps(dx_), fxl);
+	__m128 dy = _mm_mul_ps(_mm_load_ps(dy_), fyl);
+	__m128 u = _mm_load_ps(u_);
+	__m128 v = _mm_load_ps(v_);
+	__m128 id = _mm_load_ps(idepth);
+
+
+	acc.updateSSE_eighted(
+			_mm_mul_ps(id,dx),
+			_mm_mul_ps(id,dy),
+			_mm_sub_ps(zero, _mm_mul_ps(id,_mm_add_ps(_mm_mul_ps(u,dx), _mm_mul_ps(v,dy)))),
+			_mm_sub_ps(zero, _mm_add_ps(
+					_mm_mul_ps(_mm_mul_ps(u,v),dx),
+					_mm_mul_ps(dy,_mm_add_ps(one, _mm_mul_ps(v,v))))),
+			_mm_add_ps(
+					_mm_mul_ps(_mm_mul_ps(u,v),dy),
+					_mm_mul_ps(dx,_mm_add_ps(one, _mm_mul_ps(u,u)))),
+			_mm_sub_ps(_mm_mul_ps(u,dy), _mm_mul_ps(v,dx)),
+			_mm_mul_ps(a,_mm_sub_ps(b0, _mm_load_ps(refColor))),
+			minusOne,
+			_mm_load_ps(residual),
+			_mm_load_ps(weight));
+}
+
+void CoarseTracker::calcGSSSE(CoarseTrackerScratch &s, int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l)
 {
+	Accumulator9 &acc = s.acc;
 	acc.initialize();
 
 	__m128 fxl = _mm_set1_ps(fx[lvl]);
@@ -452,39 +519,20 @@ void CoarseTracker::calcGSSSE(int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &ref
 	__m128 b0 = _mm_set1_ps(lastRef_aff_g2l.b);
 	__m128 a = _mm_set1_ps((float)(AffLight::fromToVecExposure(lastRef->ab_exposure, newFrame->ab_exposure, lastRef_aff_g2l, aff_g2l)[0]));
 
-	__m128 one = _mm_set1_ps(1);
-	__m128 minusOne = _mm_set1_ps(-1);
-	__m128 zero = _mm_set1_ps(0);
-
-	int n = buf_warped_n;
+	int n = s.buf_warped_n;
 	assert(n%4==0);
 	for(int i=0;i<n;i+=4)
-	{
-		__m128 dx = _mm_mul_ps(_mm_load_ps(buf_warped_dx+i), fxl);
-		__m128 dy = _mm_mul_ps(_mm_load_ps(buf_warped_dy+i), fyl);
-		__m128 u = _mm_load_ps(buf_warped_u+i);
-		__m128 v = _mm_load_ps(buf_warped_v+i);
-		__m128 id = _mm_load_ps(buf_warped_idepth+i);
-
-
-		acc.updateSSE_eighted(
-				_mm_mul_ps(id,dx),
-				_mm_mul_ps(id,dy),
-				_mm_sub_ps(zero, _mm_mul_ps(id,_mm_add_ps(_mm_mul_ps(u,dx), _mm_mul_ps(v,dy)))),
-				_mm_sub_ps(zero, _mm_add_ps(
-						_mm_mul_ps(_mm_mul_ps(u,v),dx),
-						_mm_mul_ps(dy,_mm_add_ps(one, _mm_mul_ps(v,v))))),
-				_mm_add_ps(
-						_mm_mul_ps(_mm_mul_ps(u,v),dy),
-						_mm_mul_ps(dx,_mm_add_ps(one, _mm_mul_ps(u,u)))),
-				_mm_sub_ps(_mm_mul_ps(u,dy), _mm_mul_ps(v,dx)),
-				_mm_mul_ps(a,_mm_sub_ps(b0, _mm_load_ps(buf_warped_refColor+i))),
-				minusOne,
-				_mm_load_ps(buf_warped_residual+i),
-				_mm_load_ps(buf_warped_weight+i));
-	}
+		accumulateWarpedSSE(acc,
+				s.buf_warped_idepth+i, s.buf_warped_u+i, s.buf_warped_v+i, s.buf_warped_dx+i, s.buf_warped_dy+i,
+				s.buf_warped_residual+i, s.buf_warped_weight+i, s.buf_warped_refColor+i,
+				fxl, fyl, a, b0);
 
 	acc.finish();
+	scaleGS(acc, n, H_out, b_out);
+}
+
+void CoarseTracker::scaleGS(const Accumulator9 &acc, int n, Mat88 &H_out, Vec8 &b_out)
+{
 	H_out = acc.H.topLeftCorner<8,8>().cast<double>() * (1.0f/n);
 	b_out = acc.H.topRightCorner<8,1>().cast<double>() * (1.0f/n);
 
@@ -505,7 +553,71 @@ void CoarseTracker::calcGSSSE(int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &ref
 
 
 
-Vec6 CoarseTracker::calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, float cutoffTH)
+Vec3 CoarseTracker::calcFlowIndicators(const SE3 &refToNew)
+{
+	float fxl = fx[0];
+	float fyl = fy[0];
+	float cxl = cx[0];
+	float cyl = cy[0];
+
+	Mat33f RKi = (refToNew.rotationMatrix().cast<float>() * Ki[0]);
+	Vec3f t = (refToNew.translation()).cast<float>();
+
+	float sumSquaredShiftT=0;
+	float sumSquaredShiftRT=0;
+	float sumSquaredShiftNum=0;
+
+	int nl = pc_n[0];
+	float* lpc_u = pc_u[0];
+	float* lpc_v = pc_v[0];
+	float* lpc_idepth = pc_idepth[0];
+
+	for(int i=0;i<nl;i+=32)
+	{
+		float id = lpc_idepth[i];
+		float x = lpc_u[i];
+		float y = lpc_v[i];
+
+		//translation and rotation (positive)
+		Vec3f pt = RKi * Vec3f(x, y, 1) + t*id;
+		float Ku = fxl * (pt[0] / pt[2]) + cxl;
+		float Kv = fyl * (pt[1] / pt[2]) + cyl;
+
+		// translation only (positive)
+		Vec3f ptT = Ki[0] * Vec3f(x, y, 1) + t*id;
+		float uT = ptT[0] / ptT[2];
+		float vT = ptT[1] / ptT[2];
+		float KuT = fxl * uT + cxl;
+		float KvT = fyl * vT + cyl;
+
+		// translation only (negative)
+		Vec3f ptT2 = Ki[0] * Vec3f(x, y, 1) - t*id;
+		float uT2 = ptT2[0] / ptT2[2];
+		float vT2 = ptT2[1] / ptT2[2];
+		float KuT2 = fxl * uT2 + cxl;
+		float KvT2 = fyl * vT2 + cyl;
+
+		//translation and rotation (negative)
+		Vec3f pt3 = RKi * Vec3f(x, y, 1) - t*id;
+		float u3 = pt3[0] / pt3[2];
+		float v3 = pt3[1] / pt3[2];
+		float Ku3 = fxl * u3 + cxl;
+		float Kv3 = fyl * v3 + cyl;
+
+		sumSquaredShiftT += (KuT-x)*(KuT-x) + (KvT-y)*(KvT-y);
+		sumSquaredShiftT += (KuT2-x)*(KuT2-x) + (KvT2-y)*(KvT2-y);
+		sumSquaredShiftRT += (Ku-x)*(Ku-x) + (Kv-y)*(Kv-y);
+		sumSquaredShiftRT += (Ku3-x)*(Ku3-x) + (Kv3-y)*(Kv3-y);
+		sumSquaredShiftNum+=2;
+	}
+
+	return Vec3(sumSquaredShiftT/(sumSquaredShiftNum+0.1), 0, sumSquaredShiftRT/(sumSquaredShiftNum+0.1));
+}
+
+
+
+
+Vec6 CoarseTracker::calcResAndGS(CoarseTrackerScratch &s, int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l, float cutoffTH)
 {
 	float E = 0;
 	int numTermsInE = 0;
@@ -514,7 +626,7 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, floa
 
 	int wl = w[lvl];
 	int hl = h[lvl];
-	Eigen::Vector3f* dINewl = newFrame->dIp[lvl];
+	const PyramidLevel dINewl = newFrame->level(lvl);
 	float fxl = fx[lvl];
 	float fyl = fy[lvl];
 	float cxl = cx[lvl];
@@ -525,10 +637,172 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, floa
 	Vec3f t = (refToNew.translation()).cast<float>();
 	Vec2f affLL = AffLight::fromToVecExposure(lastRef->ab_exposure, newFrame->ab_exposure, lastRef_aff_g2l, aff_g2l).cast<float>();
 
+	float maxEnergy = 2*setting_huberTH*cutoffTH-setting_huberTH*setting_huberTH;	// energy for r=setting_coarseCutoffTH.
+
+	int nl = pc_n[lvl];
+	float* lpc_u = pc_u[lvl];
+	float* lpc_v = pc_v[lvl];
+	float* lpc_idepth = pc_idepth[lvl];
+	float* lpc_color = pc_color[lvl];
+
+	Accumulator9 &acc = s.acc;
+
+	const CoarseTrackerKernels &kernels = getCoarseTrackerKernels();
+	if(kernels.calcResAndGS != 0)
+	{
+		CoarseResInput in;
+		in.pc_u = lpc_u;
+		in.pc_v = lpc_v;
+		in.pc_idepth = lpc_idepth;
+		in.pc_color = lpc_color;
+		in.n = nl;
+		for(int c=0;c<3;c++) in.dINew[c] = dINewl.channel(c);
+		in.dINewStride = dINewl.stride();
+		in.w = wl;
+		in.h = hl;
+		for(int r=0;r<3;r++)
+		{
+			for(int c=0;c<3;c++) in.RKi[3*r+c] = RKi(r,c);
+			in.t[r] = t[r];
+		}
+		in.fx = fxl; in.fy = fyl; in.cx = cxl; in.cy = cyl;
+		in.affA = affLL[0]; in.affB = affLL[1];
+		in.a = affLL[0]; in.b0 = lastRef_aff_g2l.b;
+		in.huberTH = setting_huberTH;
+		in.cutoffTH = cutoffTH;
+		in.maxEnergy = maxEnergy;
+
+		CoarseResGSOutput out;
+		kernels.calcResAndGS(in, out);
+
+		E = out.E;
+		numTermsInE = out.numTermsInE;
+		numSaturated = out.numSaturated;
+		numTermsInWarped = out.numTermsInWarped;
+
+		int idx=0;
+		for(int r=0;r<9;r++)
+			for(int c=r;c<9;c++)
+				acc.H(r,c) = acc.H(c,r) = (float)out.H[idx++];
+	}
+	else
+	{
+		acc.initialize();
+
+		__m128 fxl4 = _mm_set1_ps(fxl);
+		__m128 fyl4 = _mm_set1_ps(fyl);
+		__m128 b04 = _mm_set1_ps(lastRef_aff_g2l.b);
+		__m128 a4 = _mm_set1_ps(affLL[0]);
+
+		// the warped points, 4 at a time.
+		EIGEN_ALIGN16 float warped[8][4];
+		int nw=0;
+
+		for(int i=0;i<nl;i++)
+		{
+			float id = lpc_idepth[i];
+			float x = lpc_u[i];
+			float y = lpc_v[i];
+
+			Vec3f pt = RKi * Vec3f(x, y, 1) + t*id;
+			float u = pt[0] / pt[2];
+			float v = pt[1] / pt[2];
+			float Ku = fxl * u + cxl;
+			float Kv = fyl * v + cyl;
+			float new_idepth = id/pt[2];
+
+			if(!(Ku > 2 && Kv > 2 && Ku < wl-3 && Kv < hl-3 && new_idepth > 0)) continue;
+
+
+
+			float refColor = lpc_color[i];
+			Vec3f hitColor = dINewl.interpolate(Ku, Kv);
+			if(!std::isfinite((float)hitColor[0])) continue;
+			float residual = hitColor[0] - (float)(affLL[0] * refColor + affLL[1]);
+			float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH / fabs(residual);
+
+
+			if(fabs(residual) > cutoffTH)
+			{
+				E += maxEnergy;
+				numTermsInE++;
+				numSaturated++;
+			}
+			else
+			{
+				E += hw *residual*residual*(2-hw);
+				numTermsInE++;
+
+				warped[0][nw] = new_idepth;
+				warped[1][nw] = u;
+				warped[2][nw] = v;
+				warped[3][nw] = hitColor[1];
+				warped[4][nw] = hitColor[2];
+				warped[5][nw] = residual;
+				warped[6][nw] = hw;
+				warped[7][nw] = refColor;
+				numTermsInWarped++;
+
+				if(++nw == 4)
+				{
+					accumulateWarpedSSE(acc, warped[0], warped[1], warped[2], warped[3], warped[4],
+							warped[5], warped[6], warped[7], fxl4, fyl4, a4, b04);
+					nw=0;
+				}
+			}
+		}
+
+		// rest, padded with zeros like calcRes does.
+		if(nw > 0)
+		{
+			for(;nw<4;nw++)
+				for(int k=0;k<8;k++) warped[k][nw] = 0;
+			accumulateWarpedSSE(acc, warped[0], warped[1], warped[2], warped[3], warped[4],
+					warped[5], warped[6], warped[7], fxl4, fyl4, a4, b04);
+		}
+
+		acc.finish();
+	}
+
+	// calcGSSSE normalizes by the number of warped points padded to 4.
+	scaleGS(acc, (numTermsInWarped+3) & ~3, H_out, b_out);
+
+	Vec3 flow = lvl==0 ? calcFlowIndicators(refToNew) : Vec3(0,0,0);
+
+	Vec6 rs;
+	rs[0] = E;
+	rs[1] = numTermsInE;
+	rs[2] = flow[0];
+	rs[3] = flow[1];
+	rs[4] = flow[2];
+	rs[5] = numSaturated / (float)numTermsInE;
+
+	return rs;
+}
+
+
+
+
+Vec6 CoarseTracker::calcRes(CoarseTrackerScratch &s, int lvl, const SE3 &refToNew, AffLight aff_g2l, float cutoffTH)
+{
+	float E = 0;
+	int numTermsInE = 0;
+	int numTermsInWarped = 0;
+	int numSaturated=0;
+
+	int wl = w[lvl];
+	int hl = h[lvl];
+	const PyramidLevel dINewl = newFrame->level(lvl);
+	float fxl = fx[lvl];
+	float fyl = fy[lvl];
+	float cxl = cx[lvl];
+	float cyl = cy[lvl];
+
+
+	Mat33f RKi = (refToNew.rotationMatrix().cast<float>() * Ki[lvl]);
+	Vec3f t = (refToNew.translation()).cast<float>();
+	Vec2f affLL = AffLight::fromToVecExposure(lastRef->ab_exposure, newFrame->ab_exposure, lastRef_aff_g2l, aff_g2l).cast<float>();
 
-	float sumSquaredShiftT=0;
-	float sumSquaredShiftRT=0;
-	float sumSquaredShiftNum=0;
 
 	float maxEnergy = 2*setting_huberTH*cutoffTH-setting_huberTH*setting_huberTH;	// energy for r=setting_coarseCutoffTH.
 
@@ -540,6 +814,16 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, floa
 		resImage->setConst(Vec3b(255,255,255));
 	}
 
+	if(s.buf_warped_idepth == 0) makeWarpedBuffers(s);
+	float* buf_warped_idepth = s.buf_warped_idepth;
+	float* buf_warped_u = s.buf_warped_u;
+	float* buf_warped_v = s.buf_warped_v;
+	float* buf_warped_dx = s.buf_warped_dx;
+	float* buf_warped_dy = s.buf_warped_dy;
+	float* buf_warped_residual = s.buf_warped_residual;
+	float* buf_warped_weight = s.buf_warped_weight;
+	float* buf_warped_refColor = s.buf_warped_refColor;
+
 	int nl = pc_n[lvl];
 	float* lpc_u = pc_u[lvl];
 	float* lpc_v = pc_v[lvl];
@@ -560,45 +844,12 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, floa
 		float Kv = fyl * v + cyl;
 		float new_idepth = id/pt[2];
 
-		if(lvl==0 && i%32==0)
-		{
-			// translation only (positive)
-			Vec3f ptT = Ki[lvl] * Vec3f(x, y, 1) + t*id;
-			float uT = ptT[0] / ptT[2];
-			float vT = ptT[1] / ptT[2];
-			float KuT = fxl * uT + cxl;
-			float KvT = fyl * vT + cyl;
-
-			// translation only (negative)
-			Vec3f ptT2 = Ki[lvl] * Vec3f(x, y, 1) - t*id;
-			float uT2 = ptT2[0] / ptT2[2];
-			float vT2 = ptT2[1] / ptT2[2];
-			float KuT2 = fxl * uT2 + cxl;
-			float KvT2 = fyl * vT2 + cyl;
-
-			//translation and rotation (negative)
-			Vec3f pt3 = RKi * Vec3f(x, y, 1) - t*id;
-			float u3 = pt3[0] / pt3[2];
-			float v3 = pt3[1] / pt3[2];
-			float Ku3 = fxl * u3 + cxl;
-			float Kv3 = fyl * v3 + cyl;
-
-			//translation and rotation (positive)
-			//already have it.
-
-			sumSquaredShiftT += (KuT-x)*(KuT-x) + (KvT-y)*(KvT-y);
-			sumSquaredShiftT += (KuT2-x)*(KuT2-x) + (KvT2-y)*(KvT2-y);
-			sumSquaredShiftRT += (Ku-x)*(Ku-x) + (Kv-y)*(Kv-y);
-			sumSquaredShiftRT += (Ku3-x)*(Ku3-x) + (Kv3-y)*(Kv3-y);
-			sumSquaredShiftNum+=2;
-		}
-
 		if(!(Ku > 2 && Kv > 2 && Ku < wl-3 && Kv < hl-3 && new_idepth > 0)) continue;
 
 
 
 		float refColor = lpc_color[i];
-        Vec3f hitColor = getInterpolatedElement33(dINewl, Ku, Kv, wl);
+        Vec3f hitColor = dINewl.interpolate(Ku, Kv);
         if(!std::isfinite((float)hitColor[0])) continue;
         float residual = hitColor[0] - (float)(affLL[0] * refColor + affLL[1]);
         float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH / fabs(residual);
@@ -642,7 +893,7 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, floa
 		buf_warped_refColor[numTermsInWarped] = 0;
 		numTermsInWarped++;
 	}
-	buf_warped_n = numTermsInWarped;
+	s.buf_warped_n = numTermsInWarped;
 
 
 	if(debugPlot)
@@ -652,12 +903,14 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, floa
 		delete resImage;
 	}
 
+	Vec3 flow = lvl==0 ? calcFlowIndicators(refToNew) : Vec3(0,0,0);
+
 	Vec6 rs;
 	rs[0] = E;
 	rs[1] = numTermsInE;
-	rs[2] = sumSquaredShiftT/(sumSquaredShiftNum+0.1);
-	rs[3] = 0;
-	rs[4] = sumSquaredShiftRT/(sumSquaredShiftNum+0.1);
+	rs[2] = flow[0];
+	rs[3] = flow[1];
+	rs[4] = flow[2];
 	rs[5] = numSaturated / (float)numTermsInE;
 
 	return rs;
@@ -704,14 +957,99 @@ bool CoarseTracker::trackNewestCoarse(
 {
 	debugPlot = setting_render_displayCoarseTrackingFull;
 	debugPrint = false;
+	newFrame = newFrameHessian;
+
+	bool good = trackHypothesis(*scratch[0], lastToNew_out, aff_g2l_out, coarsestLvl, minResForAbort);
+	lastResiduals = scratch[0]->lastResiduals;
+	lastFlowIndicators = scratch[0]->lastFlowIndicators;
+	return good;
+}
+
+void CoarseTracker::trackNewestCoarseMT(
+		FrameHessian* newFrameHessian,
+		const std::vector<SE3,Eigen::aligned_allocator<SE3>> &tries, int first, int end,
+		AffLight aff_g2l, int coarsestLvl, Vec5 minResForAbort,
+		IndexThreadReduce<Vec10>* red,
+		std::vector<CoarseTrackingResult,Eigen::aligned_allocator<CoarseTrackingResult>> &results)
+{
+	debugPlot = setting_render_displayCoarseTrackingFull;
+	debugPrint = false;
+	newFrame = newFrameHessian;
+
+	results.resize(end-first);
+	waveTries = &tries;
+	waveFirst = first;
+	waveAff_g2l = aff_g2l;
+	waveCoarsestLvl = coarsestLvl;
+	waveMinResForAbort = minResForAbort;
+	waveResults = &results;
 
+	// the debug display of calcRes can only be shown from one thread.
+	if(red == 0 || debugPlot || end-first == 1)
+	{
+		trackHypotheses_Reductor(0, end-first, 0, 0);
+		return;
+	}
+
+	while((int)scratch.size() < NUM_THREADS)
+		scratch.push_back(makeScratch());
+
+	red->reduce(boost::bind(&CoarseTracker::trackHypotheses_Reductor, this,
+			_1, _2, _3, _4), 0, end-first, 1);
+}
+
+void CoarseTracker::trackHypotheses_Reductor(int min, int max, Vec10* stats, int tid)
+{
+	CoarseTrackerScratch &s = *scratch[tid];
+	for(int k=min;k<max;k++)
+	{
+		CoarseTrackingResult &r = (*waveResults)[k];
+		r.lastToNew = (*waveTries)[waveFirst+k];
+		r.aff_g2l = waveAff_g2l;
+		r.good = trackHypothesis(s, r.lastToNew, r.aff_g2l, waveCoarsestLvl, waveMinResForAbort);
+		r.residuals = s.lastResiduals;
+		r.flowIndicators = s.lastFlowIndicators;
+		r.numChecks = s.numChecks;
+		for(int i=0;i<s.numChecks;i++)
+		{
+			r.checkLvl[i] = s.checkLvl[i];
+			r.checkResiduals[i] = s.checkResiduals[i];
+			r.checkFlowIndicators[i] = s.checkFlowIndicators[i];
+		}
+	}
+}
+
+void CoarseTracker::applyAbortThresholds(CoarseTrackingResult &r, const Vec5 &minResForAbort,
+		const SE3 &lastToNew, AffLight aff_g2l)
+{
+	// the optimization of each level does not depend on the thresholds, only whether
+	// it stops there. the first check that fails with them is where it would have stopped.
+	for(int i=0;i<r.numChecks;i++)
+	{
+		int lvl = r.checkLvl[i];
+		if(!(r.checkResiduals[i][lvl] > 1.5*minResForAbort[lvl])) continue;
+		r.good = false;
+		r.residuals = r.checkResiduals[i];
+		r.flowIndicators = r.checkFlowIndicators[i];
+		r.lastToNew = lastToNew;
+		r.aff_g2l = aff_g2l;
+		return;
+	}
+}
+
+bool CoarseTracker::trackHypothesis(CoarseTrackerScratch &s,
+		SE3 &lastToNew_out, AffLight &aff_g2l_out,
+		int coarsestLvl, const Vec5 &minResForAbort)
+{
 	assert(coarsestLvl < 5 && coarsestLvl < pyrLevelsUsed);
 
+	Vec5 &lastResiduals = s.lastResiduals;
+	Vec3 &lastFlowIndicators = s.lastFlowIndicators;
 	lastResiduals.setConstant(NAN);
 	lastFlowIndicators.setConstant(1000);
+	s.numChecks = 0;
 
 
-	newFrame = newFrameHessian;
 	int maxIterations[] = {10,20,50,50,50};
 	float lambdaExtrapolationLimit = 0.001;
 
@@ -723,19 +1061,24 @@ bool CoarseTracker::trackNewestCoarse(
 
 	for(int lvl=coarsestLvl; lvl>=0; lvl--)
 	{
+		// H and b come with the residuals, except for the debug display of calcRes.
 		Mat88 H; Vec8 b;
 		float levelCutoffRepeat=1;
-		Vec6 resOld = calcRes(lvl, refToNew_current, aff_g2l_current, setting_coarseCutoffTH*levelCutoffRepeat);
+		Vec6 resOld = debugPlot ?
+				calcRes(s, lvl, refToNew_current, aff_g2l_current, setting_coarseCutoffTH*levelCutoffRepeat) :
+				calcResAndGS(s, lvl, H, b, refToNew_current, aff_g2l_current, setting_coarseCutoffTH*levelCutoffRepeat);
 		while(resOld[5] > 0.6 && levelCutoffRepeat < 50)
 		{
 			levelCutoffRepeat*=2;
-			resOld = calcRes(lvl, refToNew_current, aff_g2l_current, setting_coarseCutoffTH*levelCutoffRepeat);
+			resOld = debugPlot ?
+					calcRes(s, lvl, refToNew_current, aff_g2l_current, setting_coarseCutoffTH*levelCutoffRepeat) :
+					calcResAndGS(s, lvl, H, b, refToNew_current, aff_g2l_current, setting_coarseCutoffTH*levelCutoffRepeat);
 
             if(!setting_debugout_runquiet)
                 printf("INCREASING cutoff to %f (ratio is %f)!\n", setting_coarseCutoffTH*levelCutoffRepeat, resOld[5]);
 		}
 
-		calcGSSSE(lvl, H, b, refToNew_current, aff_g2l_current);
+		if(debugPlot) calcGSSSE(s, lvl, H, b, refToNew_current, aff_g2l_current);
 
 		float lambda = 0.01;
 
@@ -803,7 +1146,10 @@ bool CoarseTracker::trackNewestCoarse(
 			aff_g2l_new.a += incScaled[6];
 			aff_g2l_new.b += incScaled[7];
 
-			Vec6 resNew = calcRes(lvl, refToNew_new, aff_g2l_new, setting_coarseCutoffTH*levelCutoffRepeat);
+			Mat88 H_new; Vec8 b_new;
+			Vec6 resNew = debugPlot ?
+					calcRes(s, lvl, refToNew_new, aff_g2l_new, setting_coarseCutoffTH*levelCutoffRepeat) :
+					calcResAndGS(s, lvl, H_new, b_new, refToNew_new, aff_g2l_new, setting_coarseCutoffTH*levelCutoffRepeat);
 
 			bool accept = (resNew[0] / resNew[1]) < (resOld[0] / resOld[1]);
 
@@ -822,7 +1168,8 @@ bool CoarseTracker::trackNewestCoarse(
 			}
 			if(accept)
 			{
-				calcGSSSE(lvl, H, b, refToNew_new, aff_g2l_new);
+				if(debugPlot) calcGSSSE(s, lvl, H, b, refToNew_new, aff_g2l_new);
+				else { H = H_new; b = b_new; }
 				resOld = resNew;
 				aff_g2l_current = aff_g2l_new;
 				refToNew_current = refToNew_new;
@@ -845,6 +1192,10 @@ bool CoarseTracker::trackNewestCoarse(
 		// set last residual for that level, as well as flow indicators.
 		lastResiduals[lvl] = sqrtf((float)(resOld[0] / resOld[1]));
 		lastFlowIndicators = resOld.segment<3>(2);
+		s.checkLvl[s.numChecks] = lvl;
+		s.checkResiduals[s.numChecks] = lastResiduals;
+		s.checkFlowIndicators[s.numChecks] = lastFlowIndicators;
+		s.numChecks++;
 		if(lastResiduals[lvl] > 1.5*minResForAbort[lvl]) return false;
 
 
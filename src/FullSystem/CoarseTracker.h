@@ -31,6 +31,7 @@
 #include "util/settings.h"
 #include "OptimizationBackend/MatrixAccumulators.h"
 #include "IOWrapper/Output3DWrapper.h"
+#include "util/IndexThreadReduce.h"
 
 
 
@@ -41,6 +42,53 @@ struct CalibHessian;
 struct FrameHessian;
 struct PointFrameResidual;
 
+// what tracking one hypothesis works in: the accumulator of calcResAndGS, and
+// the points warped by the last calcRes (only used for the debug display; the
+// buffers are 0 until then). one per thread that tracks.
+struct CoarseTrackerScratch
+{
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+	float* buf_warped_idepth;
+	float* buf_warped_u;
+	float* buf_warped_v;
+	float* buf_warped_dx;
+	float* buf_warped_dy;
+	float* buf_warped_residual;
+	float* buf_warped_weight;
+	float* buf_warped_refColor;
+	int buf_warped_n;
+
+	Accumulator9 acc;
+
+	Vec5 lastResiduals;
+	Vec3 lastFlowIndicators;
+
+	// lastResiduals / lastFlowIndicators at each abort check passed or failed (one per
+	// level, one more for a repeated level), see CoarseTracker::applyAbortThresholds.
+	int numChecks;
+	int checkLvl[6];
+	Vec5 checkResiduals[6];
+	Vec3 checkFlowIndicators[6];
+};
+
+// outcome of one hypothesis of trackNewestCoarseMT.
+struct CoarseTrackingResult
+{
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+	SE3 lastToNew;
+	AffLight aff_g2l;
+	bool good;
+	Vec5 residuals;			// as lastResiduals
+	Vec3 flowIndicators;	// as lastFlowIndicators
+
+	int numChecks;			// as in CoarseTrackerScratch
+	int checkLvl[6];
+	Vec5 checkResiduals[6];
+	Vec3 checkFlowIndicators[6];
+};
+
 class CoarseTracker {
 public:
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
@@ -54,6 +102,24 @@ public:
 			int coarsestLvl, Vec5 minResForAbort,
 			IOWrap::Output3DWrapper* wrap=0);
 
+	// tracks the hypotheses tries[first..end) (all starting from [aff_g2l]) as
+	// trackNewestCoarse does, on the threads of [red], one hypothesis per thread.
+	// all of them abort on [minResForAbort], none sees the others' results, so the
+	// outcome does not depend on timing. results[i] is for tries[first+i].
+	// without [red], or with the coarse tracking display on, one after the other.
+	void trackNewestCoarseMT(
+			FrameHessian* newFrameHessian,
+			const std::vector<SE3,Eigen::aligned_allocator<SE3>> &tries, int first, int end,
+			AffLight aff_g2l, int coarsestLvl, Vec5 minResForAbort,
+			IndexThreadReduce<Vec10>* red,
+			std::vector<CoarseTrackingResult,Eigen::aligned_allocator<CoarseTrackingResult>> &results);
+
+	// [r] as if it had been tracked with the (tighter) [minResForAbort] from
+	// [lastToNew] / [aff_g2l]: replays the abort checks it went through. merging the
+	// results of trackNewestCoarseMT in order with this gives exactly the serial outcome.
+	static void applyAbortThresholds(CoarseTrackingResult &r, const Vec5 &minResForAbort,
+			const SE3 &lastToNew, AffLight aff_g2l);
+
 	void setCTRefForFirstFrame(
 			std::vector<FrameHessian*> frameHessians);
 
@@ -65,6 +131,9 @@ public:
 	void makeK(
 			CalibHessian* HCalib);
 
+	// forget the reference frame (after a full reset). buffers are kept.
+	void reset();
+
 	bool debugPrint, debugPlot;
 
 	Mat33f K[PYR_LEVELS];
@@ -101,11 +170,21 @@ private:
 	float* weightSums_bak[PYR_LEVELS];
 
 
-	Vec6 calcResAndGS(int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l, float cutoffTH);
-	Vec6 calcRes(int lvl, const SE3 &refToNew, AffLight aff_g2l, float cutoffTH);
-	void calcGSSSE(int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l);
+	// calcRes followed by calcGSSSE, in one pass over the points and without the warped buffers.
+	Vec6 calcResAndGS(CoarseTrackerScratch &s, int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l, float cutoffTH);
+	Vec6 calcRes(CoarseTrackerScratch &s, int lvl, const SE3 &refToNew, AffLight aff_g2l, float cutoffTH);
+	void calcGSSSE(CoarseTrackerScratch &s, int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l);
+	void scaleGS(const Accumulator9 &acc, int n, Mat88 &H_out, Vec8 &b_out);
+	// (mean squared shift by translation only, 0, by translation and rotation) of level 0.
+	Vec3 calcFlowIndicators(const SE3 &refToNew);
 	void calcGS(int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l);
 
+	// one hypothesis, in [s].
+	bool trackHypothesis(CoarseTrackerScratch &s,
+			SE3 &lastToNew_out, AffLight &aff_g2l_out,
+			int coarsestLvl, const Vec5 &minResForAbort);
+	void trackHypotheses_Reductor(int min, int max, Vec10* stats, int tid);
+
 	// pc buffers
 	float* pc_u[PYR_LEVELS];
 	float* pc_v[PYR_LEVELS];
@@ -113,22 +192,24 @@ private:
 	float* pc_color[PYR_LEVELS];
 	int pc_n[PYR_LEVELS];
 
-	// warped buffers
-	float* buf_warped_idepth;
-	float* buf_warped_u;
-	float* buf_warped_v;
-	float* buf_warped_dx;
-	float* buf_warped_dy;
-	float* buf_warped_residual;
-	float* buf_warped_weight;
-	float* buf_warped_refColor;
-	int buf_warped_n;
-
+	// warped buffers. [0] always exists, the others (one per thread of
+	// trackNewestCoarseMT) are made the first time they are needed.
+	CoarseTrackerScratch* makeScratch();
+	void makeWarpedBuffers(CoarseTrackerScratch &s);
+	std::vector<CoarseTrackerScratch*> scratch;
+	int scratchSize;
 
-    std::vector<float*> ptrToDelete;
+	// arguments of the running trackNewestCoarseMT, for trackHypotheses_Reductor.
+	// read-only while the hypotheses are tracked.
+	const std::vector<SE3,Eigen::aligned_allocator<SE3>>* waveTries;
+	int waveFirst;
+	AffLight waveAff_g2l;
+	int waveCoarsestLvl;
+	Vec5 waveMinResForAbort;
+	std::vector<CoarseTrackingResult,Eigen::aligned_allocator<CoarseTrackingResult>>* waveResults;
 
 
-	Accumulator9 acc;
+    std::vector<float*> ptrToDelete;
 };
 
 
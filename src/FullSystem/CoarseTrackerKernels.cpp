@@ -0,0 +1,62 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "FullSystem/CoarseTrackerKernels.h"
+#include <stdio.h>
+
+namespace dso
+{
+
+static CoarseTrackerKernels pickCoarseTrackerKernels()
+{
+	CoarseTrackerKernels k;
+	k.calcResAndGS = 0;
+	k.name = "SSE";
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f"))
+	{
+		k.calcResAndGS = avx512::calcResAndGS;
+		k.name = "AVX-512";
+	}
+	else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+	{
+		k.calcResAndGS = avx2::calcResAndGS;
+		k.name = "AVX2";
+	}
+#endif
+
+	printf("CoarseTracker: using %s kernels.\n", k.name);
+	return k;
+}
+
+const CoarseTrackerKernels& getCoarseTrackerKernels()
+{
+	static const CoarseTrackerKernels kernels = pickCoarseTrackerKernels();
+	return kernels;
+}
+
+}
@@ -0,0 +1,90 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+// wide (AVX2 / AVX-512) versions of the inner loops of CoarseTracker. they are
+// compiled with their own instruction set flags and chosen at runtime, so this
+// header (and the kernels) must not pull in Eigen or anything else that has
+// inline code shared with the rest of the program.
+
+namespace dso
+{
+
+// what CoarseTracker::calcResAndGS needs for one level.
+struct CoarseResInput
+{
+	const float* pc_u;
+	const float* pc_v;
+	const float* pc_idepth;
+	const float* pc_color;
+	int n;
+
+	// I, dx, dy of the new frame (w*h): channel c of pixel i is dINew[c][i*dINewStride],
+	// as from PyramidLevel::channel / stride.
+	const float* dINew[3];
+	int dINewStride;
+	int w, h;
+
+	float RKi[9];		// row-major
+	float t[3];
+	float fx, fy, cx, cy;
+	float affA, affB;	// reference color -> new frame
+	float a, b0;		// for the derivatives by the affine parameters
+	float huberTH, cutoffTH, maxEnergy;
+};
+
+struct CoarseResGSOutput
+{
+	float E;
+	int numTermsInE;
+	int numSaturated;
+	int numTermsInWarped;	// residuals that are not cut off, not padded to 4.
+
+	// upper triangle (row-major, 45 values) of the 9x9 system [J r]^T W [J r].
+	double H[45];
+};
+
+typedef void (*CoarseResGSKernel)(const CoarseResInput& in, CoarseResGSOutput& out);
+
+namespace avx2
+{
+void calcResAndGS(const CoarseResInput& in, CoarseResGSOutput& out);
+}
+namespace avx512
+{
+void calcResAndGS(const CoarseResInput& in, CoarseResGSOutput& out);
+}
+
+struct CoarseTrackerKernels
+{
+	CoarseResGSKernel calcResAndGS;	// 0: none, use the SSE code.
+	const char* name;
+};
+
+// the widest kernels this CPU can run, picked on the first call.
+const CoarseTrackerKernels& getCoarseTrackerKernels();
+
+}
@@ -0,0 +1,162 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// the kernel of CoarseTrackerKernels.h, written once for any vector width.
+// included by CoarseTrackerKernels_<isa>.cpp inside namespace dso::<isa>, after
+// that defined W (lanes) and the vector types F, I, M with:
+//   set1 set1I loadN add sub mul div fmadd abs hsum hsumDouble
+//   cmpLT cmpGT andM andNotM firstN count select zeroUnless isFinite
+//   toInt toFloat addI mulI gather
+// no include guard on purpose.
+
+// the sums of H are kept in float for gsBlockSize points at a time, then added up in double.
+static const int gsBlockSize = 1024;
+
+// the scalar loop of CoarseTracker::calcRes (without the debug image and the flow
+// indicators, done by the caller), and for every residual that is not cut off
+// what Accumulator9::updateSSE_eighted does with it in CoarseTracker::calcGSSSE.
+void calcResAndGS(const CoarseResInput& in, CoarseResGSOutput& out)
+{
+	const F R00 = set1(in.RKi[0]), R01 = set1(in.RKi[1]), R02 = set1(in.RKi[2]);
+	const F R10 = set1(in.RKi[3]), R11 = set1(in.RKi[4]), R12 = set1(in.RKi[5]);
+	const F R20 = set1(in.RKi[6]), R21 = set1(in.RKi[7]), R22 = set1(in.RKi[8]);
+	const F t0 = set1(in.t[0]), t1 = set1(in.t[1]), t2 = set1(in.t[2]);
+	const F fx = set1(in.fx), fy = set1(in.fy), cx = set1(in.cx), cy = set1(in.cy);
+	const F affA = set1(in.affA), affB = set1(in.affB);
+	const F a = set1(in.a), b0 = set1(in.b0);
+	const F huberTH = set1(in.huberTH), cutoffTH = set1(in.cutoffTH), maxEnergy = set1(in.maxEnergy);
+	const F zero = set1(0), one = set1(1), two = set1(2), minusOne = set1(-1);
+	const F uMax = set1(in.w-3), vMax = set1(in.h-3);
+	const I wl = set1I(in.w);
+	const I stride = set1I(in.dINewStride);
+
+	F E = zero;
+	int numTermsInE = 0, numSaturated = 0, numTermsInWarped = 0;
+	for(int k=0;k<45;k++) out.H[k] = 0;
+
+	F acc[45];
+	for(int start=0; start<in.n; start+=gsBlockSize)
+	{
+		int end = in.n < start+gsBlockSize ? in.n : start+gsBlockSize;
+		for(int k=0;k<45;k++) acc[k] = zero;
+
+		for(int i=start;i<end;i+=W)
+		{
+			int num = end-i < W ? end-i : W;
+			M active = firstN(num);
+			F x = loadN(in.pc_u+i, num);
+			F y = loadN(in.pc_v+i, num);
+			F id = loadN(in.pc_idepth+i, num);
+			F color = loadN(in.pc_color+i, num);
+
+			// pt = RKi * (x,y,1) + t*id.
+			F pt0 = add(add(add(mul(R00,x), mul(R01,y)), R02), mul(t0,id));
+			F pt1 = add(add(add(mul(R10,x), mul(R11,y)), R12), mul(t1,id));
+			F pt2 = add(add(add(mul(R20,x), mul(R21,y)), R22), mul(t2,id));
+			F u = div(pt0, pt2);
+			F v = div(pt1, pt2);
+			F Ku = add(mul(fx,u), cx);
+			F Kv = add(mul(fy,v), cy);
+			F new_idepth = div(id, pt2);
+
+			M valid = andM(andM(active, andM(cmpGT(Ku,two), cmpGT(Kv,two))),
+					andM(andM(cmpLT(Ku,uMax), cmpLT(Kv,vMax)), cmpGT(new_idepth,zero)));
+
+			// getInterpolatedElement33, only for the valid lanes.
+			I ix = toInt(Ku);
+			I iy = toInt(Kv);
+			F dx = sub(Ku, toFloat(ix));
+			F dy = sub(Kv, toFloat(iy));
+			F dxdy = mul(dx,dy);
+			F w11 = dxdy;
+			F w01 = sub(dy,dxdy);
+			F w10 = sub(dx,dxdy);
+			F w00 = add(sub(sub(one,dx),dy),dxdy);
+			I i00 = mulI(addI(ix, mulI(iy, wl)), stride);
+			I i10 = addI(i00, stride);
+			I i01 = addI(i00, mulI(wl, stride));
+			I i11 = addI(i01, stride);
+
+			F hit[3];
+			for(int c=0;c<3;c++)
+			{
+				const float* base = in.dINew[c];
+				hit[c] = add(add(add(
+						mul(w11, gather(base, i11, valid)),
+						mul(w01, gather(base, i01, valid))),
+						mul(w10, gather(base, i10, valid))),
+						mul(w00, gather(base, i00, valid)));
+			}
+			valid = andM(valid, isFinite(hit[0]));
+
+			F residual = sub(hit[0], add(mul(affA,color), affB));
+			F absRes = abs(residual);
+			F hw = select(cmpLT(absRes,huberTH), one, div(huberTH,absRes));
+
+			M saturated = andM(valid, cmpGT(absRes,cutoffTH));
+			M good = andNotM(valid, saturated);
+
+			F e = mul(mul(mul(hw,residual),residual), sub(two,hw));
+			E = add(E, select(saturated, maxEnergy, zeroUnless(good, e)));
+			numTermsInE += count(valid);
+			numSaturated += count(saturated);
+			numTermsInWarped += count(good);
+
+			// the lanes that are not good get weight 0 and finite values.
+			F gu = zeroUnless(good, u);
+			F gv = zeroUnless(good, v);
+			F gid = zeroUnless(good, new_idepth);
+			F gdx = mul(zeroUnless(good, hit[1]), fx);
+			F gdy = mul(zeroUnless(good, hit[2]), fy);
+			F gw = zeroUnless(good, hw);
+
+			F J[9];
+			J[0] = mul(gid,gdx);
+			J[1] = mul(gid,gdy);
+			J[2] = sub(zero, mul(gid, add(mul(gu,gdx), mul(gv,gdy))));
+			J[3] = sub(zero, add(mul(mul(gu,gv),gdx), mul(gdy, add(one, mul(gv,gv)))));
+			J[4] = add(mul(mul(gu,gv),gdy), mul(gdx, add(one, mul(gu,gu))));
+			J[5] = sub(mul(gu,gdy), mul(gv,gdx));
+			J[6] = mul(a, sub(b0, color));
+			J[7] = minusOne;
+			J[8] = zeroUnless(good, residual);
+
+			int k=0;
+			for(int r=0;r<9;r++)
+			{
+				F Jw = mul(J[r], gw);
+				for(int c=r;c<9;c++,k++)
+					acc[k] = fmadd(Jw, J[c], acc[k]);
+			}
+		}
+
+		for(int k=0;k<45;k++) out.H[k] += hsumDouble(acc[k]);
+	}
+
+	out.E = hsum(E);
+	out.numTermsInE = numTermsInE;
+	out.numSaturated = numSaturated;
+	out.numTermsInWarped = numTermsInWarped;
+}
@@ -0,0 +1,87 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// compiled with -mavx2 -mfma (see CMakeLists.txt), only called if the CPU has them.
+#include "FullSystem/CoarseTrackerKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace dso
+{
+namespace avx2
+{
+
+static const int W = 8;
+typedef __m256 F;
+typedef __m256i I;
+typedef __m256 M;	// all bits set in the lanes that are on.
+
+static inline F set1(float v) {return _mm256_set1_ps(v);}
+static inline I set1I(int v) {return _mm256_set1_epi32(v);}
+static inline M firstN(int n) {return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0,1,2,3,4,5,6,7)));}
+static inline F loadN(const float* p, int n) {return n == W ? _mm256_loadu_ps(p) : _mm256_maskload_ps(p, _mm256_castps_si256(firstN(n)));}
+
+static inline F add(F a, F b) {return _mm256_add_ps(a,b);}
+static inline F sub(F a, F b) {return _mm256_sub_ps(a,b);}
+static inline F mul(F a, F b) {return _mm256_mul_ps(a,b);}
+static inline F div(F a, F b) {return _mm256_div_ps(a,b);}
+static inline F fmadd(F a, F b, F c) {return _mm256_fmadd_ps(a,b,c);}
+static inline F abs(F a) {return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);}
+static inline float hsum(F a)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a,1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s,s));
+	s = _mm_add_ss(s, _mm_movehdup_ps(s));
+	return _mm_cvtss_f32(s);
+}
+static inline double hsumDouble(F a)
+{
+	__m256d s = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(a)), _mm256_cvtps_pd(_mm256_extractf128_ps(a,1)));
+	__m128d s2 = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s,1));
+	return _mm_cvtsd_f64(_mm_add_sd(s2, _mm_unpackhi_pd(s2,s2)));
+}
+
+static inline M cmpLT(F a, F b) {return _mm256_cmp_ps(a,b,_CMP_LT_OQ);}
+static inline M cmpGT(F a, F b) {return _mm256_cmp_ps(a,b,_CMP_GT_OQ);}
+static inline M andM(M a, M b) {return _mm256_and_ps(a,b);}
+static inline M andNotM(M a, M b) {return _mm256_andnot_ps(b,a);}	// a and not b
+static inline int count(M m) {return __builtin_popcount(_mm256_movemask_ps(m));}
+static inline F select(M m, F a, F b) {return _mm256_blendv_ps(b,a,m);}
+static inline F zeroUnless(M m, F a) {return _mm256_and_ps(m,a);}
+static inline M isFinite(F a) {return _mm256_cmp_ps(_mm256_sub_ps(a,a), _mm256_setzero_ps(), _CMP_EQ_OQ);}
+
+static inline I toInt(F a) {return _mm256_cvttps_epi32(a);}
+static inline F toFloat(I a) {return _mm256_cvtepi32_ps(a);}
+static inline I addI(I a, I b) {return _mm256_add_epi32(a,b);}
+static inline I mulI(I a, I b) {return _mm256_mullo_epi32(a,b);}
+static inline F gather(const float* base, I idx, M m) {return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, idx, m, 4);}
+
+#include "FullSystem/CoarseTrackerKernelsImpl.h"
+
+}
+}
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+// compiled with -mavx512f (see CMakeLists.txt), only called if the CPU has it.
+#include "FullSystem/CoarseTrackerKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace dso
+{
+namespace avx512
+{
+
+static const int W = 16;
+typedef __m512 F;
+typedef __m512i I;
+typedef __mmask16 M;
+
+static inline F set1(float v) {return _mm512_set1_ps(v);}
+static inline I set1I(int v) {return _mm512_set1_epi32(v);}
+static inline M firstN(int n) {return (M)((1u << n) - 1);}
+static inline F loadN(const float* p, int n) {return n == W ? _mm512_loadu_ps(p) : _mm512_maskz_loadu_ps(firstN(n), p);}
+
+static inline F add(F a, F b) {return _mm512_add_ps(a,b);}
+static inline F sub(F a, F b) {return _mm512_sub_ps(a,b);}
+static inline F mul(F a, F b) {return _mm512_mul_ps(a,b);}
+static inline F div(F a, F b) {return _mm512_div_ps(a,b);}
+static inline F fmadd(F a, F b, F c) {return _mm512_fmadd_ps(a,b,c);}
+static inline F abs(F a) {return _mm512_abs_ps(a);}
+static inline float hsum(F a) {return _mm512_reduce_add_ps(a);}
+static inline double hsumDouble(F a)
+{
+	return _mm512_reduce_add_pd(_mm512_add_pd(
+			_mm512_cvtps_pd(_mm512_castps512_ps256(a)),
+			_mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a),1)))));
+}
+
+static inline M cmpLT(F a, F b) {return _mm512_cmp_ps_mask(a,b,_CMP_LT_OQ);}
+static inline M cmpGT(F a, F b) {return _mm512_cmp_ps_mask(a,b,_CMP_GT_OQ);}
+static inline M andM(M a, M b) {return a & b;}
+static inline M andNotM(M a, M b) {return a & ~b;}
+static inline int count(M m) {return __builtin_popcount(m);}
+static inline F select(M m, F a, F b) {return _mm512_mask_blend_ps(m,b,a);}
+static inline F zeroUnless(M m, F a) {return _mm512_maskz_mov_ps(m,a);}
+static inline M isFinite(F a) {return _mm512_cmp_ps_mask(_mm512_sub_ps(a,a), _mm512_setzero_ps(), _CMP_EQ_OQ);}
+
+static inline I toInt(F a) {return _mm512_cvttps_epi32(a);}
+static inline F toFloat(I a) {return _mm512_cvtepi32_ps(a);}
+static inline I addI(I a, I b) {return _mm512_add_epi32(a,b);}
+static inline I mulI(I a, I b) {return _mm512_mullo_epi32(a,b);}
+static inline F gather(const float* base, I idx, M m) {return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, idx, base, 4);}
+
+#include "FullSystem/CoarseTrackerKernelsImpl.h"
+
+}
+}
+
+#endif
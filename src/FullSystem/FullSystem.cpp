@@ -57,14 +57,15 @@
 #include <cmath>
 
 #include <chrono>
-#include <monodepth2/monodepth.h>
+#include "monodepth2/DepthPredictor.h"
 
 namespace dso {
 int FrameHessian::instanceCounter = 0;
 int PointHessian::instanceCounter = 0;
 int CalibHessian::instanceCounter = 0;
 
-FullSystem::FullSystem(const std::string &path_cnn) {
+FullSystem::FullSystem(std::shared_ptr<DepthPredictor> depthPredictor)
+    : depthPredictor(depthPredictor) {
 
   int retstat = 0;
 
@@ -170,12 +171,26 @@ FullSystem::FullSystem(const std::string &path_cnn) {
   minIdJetVisTracker = -1;
   maxIdJetVisTracker = -1;
 
-  bool useGPU = true;
-  depthPredictor = new MonoDepth(path_cnn, useGPU);
+  runDepthInference = true;
+  numRecordJobs = 0;
+  numPrecomputedHit = numPrecomputedMissed = 0;
+  depthThread = boost::thread(&FullSystem::depthInferenceLoop, this);
 }
 FullSystem::~FullSystem() {
   blockUntilMappingIsFinished();
 
+  {
+    boost::unique_lock<boost::mutex> lock(depthMapCacheMutex);
+    runDepthInference = false;
+    depthJobSignal.notify_all();
+  }
+  depthThread.join();
+
+  if (numPrecomputedHit + numPrecomputedMissed > 0)
+    printf("predictDepthBatch: %d of %d predicted KFs hit, %d missed.\n",
+           numPrecomputedHit, numPrecomputedHit + numPrecomputedMissed,
+           numPrecomputedMissed);
+
   if (setting_logStuff) {
     calibLog->close();
     delete calibLog;
@@ -211,7 +226,92 @@ FullSystem::~FullSystem() {
   delete coarseInitializer;
   delete pixelSelector;
   delete ef;
-  delete depthPredictor;
+}
+
+void FullSystem::reset() {
+  // only the mapping thread is restarted; the depth thread, the treadReduce
+  // workers and all image-sized buffers are reused.
+  blockUntilMappingIsFinished();
+
+  {
+    boost::unique_lock<boost::mutex> lock(depthMapCacheMutex);
+    // frames still to be recorded stay queued, depthStore outlives the reset.
+    std::deque<DepthJob> recordJobs;
+    for (DepthJob &job : depthJobs) {
+      if (job.record)
+        recordJobs.push_back(job);
+      else
+        job.result->set_value(DepthPrediction());
+    }
+    depthJobs.swap(recordJobs);
+    numRecordJobs = depthJobs.size();
+    depthJobSignal.notify_all();
+    depthMapCache.clear();
+    numPrecomputedMissed += precomputedDepthMaps.size();
+    precomputedDepthMaps.clear();
+  }
+
+  for (FrameHessian *fh : unmappedTrackedFrames)
+    delete fh;
+  unmappedTrackedFrames.clear();
+
+  // unlinks all EF structs from frames, points and residuals.
+  delete ef;
+  ef = new EnergyFunctional();
+  ef->red = &this->treadReduce;
+
+  // first frame is only owned by the initializer until it became a KF.
+  if (allKeyFramesHistory.size() == 0 && coarseInitializer->firstFrame != 0)
+    delete coarseInitializer->firstFrame;
+  for (FrameHessian *fh : frameHessians)
+    delete fh;
+  frameHessians.clear();
+  activeResiduals.clear();
+
+  for (FrameShell *s : allFrameHistory)
+    delete s;
+  allFrameHistory.clear();
+  allKeyFramesHistory.clear();
+  point_cloud.clear();
+
+  coarseTracker->reset();
+  coarseTracker_forNewKF->reset();
+  coarseInitializer->reset();
+  pixelSelector->reset();
+
+  // fresh calibration, but keep the gamma function.
+  CalibHessian freshCalib;
+  memcpy(freshCalib.Binv, Hcalib.Binv, sizeof(float) * 256);
+  memcpy(freshCalib.B, Hcalib.B, sizeof(float) * 256);
+  Hcalib = freshCalib;
+
+  statistics_lastNumOptIts = 0;
+  statistics_numDroppedPoints = 0;
+  statistics_numActivatedPoints = 0;
+  statistics_numCreatedPoints = 0;
+  statistics_numForceDroppedResBwd = 0;
+  statistics_numForceDroppedResFwd = 0;
+  statistics_numMargResFwd = 0;
+  statistics_numMargResBwd = 0;
+
+  lastCoarseRMSE.setConstant(100);
+
+  currentMinActDist = 2;
+  initialized = false;
+  isLost = false;
+  initFailed = false;
+
+  needNewKFAfter = -1;
+  needToKetchupMapping = false;
+  lastRefStopID = 0;
+
+  minIdJetVisDebug = -1;
+  maxIdJetVisDebug = -1;
+  minIdJetVisTracker = -1;
+  maxIdJetVisTracker = -1;
+
+  runMapping = true;
+  mappingThread = boost::thread(&FullSystem::mappingLoop, this);
 }
 
 void FullSystem::setOriginalCalib(const VecXf &originalCalib, int originalW,
@@ -598,51 +698,69 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
   Vec5 achievedRes = Vec5::Constant(NAN);
   bool haveOneGood = false;
   int tryIterations = 0;
-  for (unsigned int i = 0; i < lastF_2_fh_tries.size(); i++) {
-    AffLight aff_g2l_this = aff_last_2_l;
-    SE3 lastF_2_fh_this = lastF_2_fh_tries[i];
-    bool trackingIsGood = coarseTracker->trackNewestCoarse(
-        fh, lastF_2_fh_this, aff_g2l_this, pyrLevelsUsed - 1,
-        achievedRes); // in each level has to be at least as good as the last
-                      // try.
-    tryIterations++;
-
-    if (i != 0) {
-      printf("RE-TRACK ATTEMPT %d with initOption %d and start-lvl %d (ab %f "
-             "%f): %f %f %f %f %f -> %f %f %f %f %f \n",
-             i, i, pyrLevelsUsed - 1, aff_g2l_this.a, aff_g2l_this.b,
-             achievedRes[0], achievedRes[1], achievedRes[2], achievedRes[3],
-             achievedRes[4], coarseTracker->lastResiduals[0],
-             coarseTracker->lastResiduals[1], coarseTracker->lastResiduals[2],
-             coarseTracker->lastResiduals[3], coarseTracker->lastResiduals[4]);
-    }
 
-    // do we have a new winner?
-    if (trackingIsGood &&
-        std::isfinite((float)coarseTracker->lastResiduals[0]) &&
-        !(coarseTracker->lastResiduals[0] >= achievedRes[0])) {
-      // printf("take over. minRes %f -> %f!\n", achievedRes[0],
-      // coarseTracker->lastResiduals[0]);
-      flowVecs = coarseTracker->lastFlowIndicators;
-      aff_g2l = aff_g2l_this;
-      lastF_2_fh = lastF_2_fh_this;
-      haveOneGood = true;
-    }
+  // the first option (constant motion) is almost always good enough and is
+  // tracked on its own. the others come in waves of NUM_THREADS, tracked in
+  // parallel with the thresholds from before the wave. their results are taken
+  // in order, each re-checked against the thresholds so far, so the outcome is
+  // the same as tracking them one by one.
+  std::vector<CoarseTrackingResult, Eigen::aligned_allocator<CoarseTrackingResult>>
+      results;
+  bool done = false;
+  for (int waveStart = 0;
+       waveStart < (int)lastF_2_fh_tries.size() && !done;) {
+    int waveEnd = waveStart + (waveStart == 0 || !multiThreading ? 1 : NUM_THREADS);
+    waveEnd = std::min(waveEnd, (int)lastF_2_fh_tries.size());
+    coarseTracker->trackNewestCoarseMT(
+        fh, lastF_2_fh_tries, waveStart, waveEnd, aff_last_2_l,
+        pyrLevelsUsed - 1, achievedRes,
+        multiThreading ? &trackReduce : 0,
+        results); // in each level has to be at least as good as the last try.
+
+    for (int i = waveStart; i < waveEnd; i++) {
+      CoarseTrackingResult &res = results[i - waveStart];
+      CoarseTracker::applyAbortThresholds(res, achievedRes, lastF_2_fh_tries[i],
+                                          aff_last_2_l);
+      tryIterations++;
+
+      if (i != 0) {
+        printf("RE-TRACK ATTEMPT %d with initOption %d and start-lvl %d (ab %f "
+               "%f): %f %f %f %f %f -> %f %f %f %f %f \n",
+               i, i, pyrLevelsUsed - 1, res.aff_g2l.a, res.aff_g2l.b,
+               achievedRes[0], achievedRes[1], achievedRes[2], achievedRes[3],
+               achievedRes[4], res.residuals[0], res.residuals[1],
+               res.residuals[2], res.residuals[3], res.residuals[4]);
+      }
 
-    // take over achieved res (always).
-    if (haveOneGood) {
-      for (int i = 0; i < 5; i++) {
-        if (!std::isfinite((float)achievedRes[i]) ||
-            achievedRes[i] >
-                coarseTracker->lastResiduals[i]) // take over if achievedRes is
-                                                 // either bigger or NAN.
-          achievedRes[i] = coarseTracker->lastResiduals[i];
+      // do we have a new winner?
+      if (res.good && std::isfinite((float)res.residuals[0]) &&
+          !(res.residuals[0] >= achievedRes[0])) {
+        // printf("take over. minRes %f -> %f!\n", achievedRes[0],
+        // res.residuals[0]);
+        flowVecs = res.flowIndicators;
+        aff_g2l = res.aff_g2l;
+        lastF_2_fh = res.lastToNew;
+        haveOneGood = true;
       }
-    }
 
-    if (haveOneGood &&
-        achievedRes[0] < lastCoarseRMSE[0] * setting_reTrackThreshold)
-      break;
+      // take over achieved res (always).
+      if (haveOneGood) {
+        for (int i = 0; i < 5; i++) {
+          if (!std::isfinite((float)achievedRes[i]) ||
+              achievedRes[i] >
+                  res.residuals[i]) // take over if achievedRes is
+                                    // either bigger or NAN.
+            achievedRes[i] = res.residuals[i];
+        }
+      }
+
+      if (haveOneGood &&
+          achievedRes[0] < lastCoarseRMSE[0] * setting_reTrackThreshold) {
+        done = true;
+        break;
+      }
+    }
+    waveStart = waveEnd;
   }
 
   if (!haveOneGood) {
@@ -1046,10 +1164,9 @@ void FullSystem::addActiveFrame(ImageAndExposure *image, int id,
 
     bool needToMakeKF = false;
     if (setting_keyframesPerSecond > 0) {
-      needToMakeKF =
-          allFrameHistory.size() == 1 ||
-          (fh->shell->timestamp - allKeyFramesHistory.back()->timestamp) >
-              0.95f / setting_keyframesPerSecond;
+      needToMakeKF = allFrameHistory.size() == 1 ||
+                     isKeyframeDue(fh->shell->timestamp,
+                                   allKeyFramesHistory.back()->timestamp);
     } else {
       Vec2 refToFh = AffLight::fromToVecExposure(
           coarseTracker->lastRef->ab_exposure, fh->ab_exposure,
@@ -1072,6 +1189,14 @@ void FullSystem::addActiveFrame(ImageAndExposure *image, int id,
     for (IOWrap::Output3DWrapper *ow : outputWrapper)
       ow->publishCamPose(fh->shell, &Hcalib);
 
+    // start the network now, it will be consumed in makeNewTraces().
+    if (needToMakeKF)
+      requestDepthMap(fh);
+    // recording: store every frame, other settings may pick other KFs. the
+    // depth thread writes it, nothing waits for the result here.
+    else if (depthStore && !depthStore->isReader())
+      requestDepthMap(fh);
+
     lock.unlock();
     deliverTrackedFrame(fh, needToMakeKF);
     return;
@@ -1157,6 +1282,7 @@ void FullSystem::mappingLoop() {
           fh->setEvalPT_scaled(fh->shell->camToWorld.inverse(),
                                fh->shell->aff_g2l);
         }
+        evictDepthMap(fh);
         delete fh;
       }
 
@@ -1199,6 +1325,7 @@ void FullSystem::makeNonKeyFrame(FrameHessian *fh) {
   }
 
   traceNewCoarse(fh);
+  evictDepthMap(fh);
   delete fh;
 }
 
@@ -1647,12 +1774,155 @@ void FullSystem::printLogLine() {
   }
 }
 
+std::shared_future<DepthPrediction>
+FullSystem::requestDepthMap(FrameHessian *fh) {
+  int id = fh->shell->id;
+  boost::unique_lock<boost::mutex> lock(depthMapCacheMutex);
+  auto it = depthMapCache.find(id);
+  if (it != depthMapCache.end())
+    return it->second;
+
+  DepthJob job;
+  job.id = id;
+  job.incomingId = fh->shell->incoming_id;
+  job.image = fh->rgb_image;
+  job.record = depthStore && !depthStore->isReader();
+  job.result = std::make_shared<std::promise<DepthPrediction>>();
+  std::shared_future<DepthPrediction> prediction =
+      job.result->get_future().share();
+  depthMapCache[id] = prediction;
+
+  // already inferred as part of an offline batch.
+  auto pre = precomputedDepthMaps.find(fh->shell->incoming_id);
+  if (pre != precomputedDepthMaps.end()) {
+    if (depthStore)
+      depthStore->write(job.incomingId, pre->second.invdepth);
+    job.result->set_value(pre->second);
+    precomputedDepthMaps.erase(pre);
+    numPrecomputedHit++;
+    return prediction;
+  }
+
+  if (!multiThreading) {
+    // no depth thread: run the network right here.
+    lock.unlock();
+    std::vector<int> ids(1, job.incomingId);
+    std::vector<cv::Mat> images(1, job.image);
+    std::vector<DepthPrediction> results;
+    depthPredictor->predict(ids, images, results);
+    if (depthStore)
+      depthStore->write(job.incomingId, results[0].invdepth);
+    job.result->set_value(results[0]);
+    return prediction;
+  }
+
+  // recording: every frame is queued, and the network is usually slower than
+  // the camera. wait instead of piling up color images.
+  if (job.record) {
+    while (runDepthInference && numRecordJobs >= setting_depthRecordQueue)
+      depthJobSignal.wait(lock);
+    numRecordJobs++;
+  }
+
+  depthJobs.push_back(job);
+  depthJobSignal.notify_all();
+  return prediction;
+}
+
 cv::Mat FullSystem::getDepthMap(FrameHessian *fh) {
-  cv::Mat image = fh->rgb_image;
-  cv::Mat invdepth;
-  depthPredictor->inference(image, invdepth);
   // depth = 0.3128f / (depth + 0.00001f);
-  return invdepth;
+  return requestDepthMap(fh).get().invdepth;
+}
+
+void FullSystem::evictDepthMap(FrameHessian *fh) {
+  boost::unique_lock<boost::mutex> lock(depthMapCacheMutex);
+  depthMapCache.erase(fh->shell->id);
+  numPrecomputedMissed += precomputedDepthMaps.erase(fh->shell->incoming_id);
+}
+
+bool FullSystem::isKeyframeDue(double timestamp, double lastKFTimestamp) {
+  // signed: played backwards, the rate never asks for a KF.
+  return !std::isfinite(lastKFTimestamp) ||
+         (timestamp - lastKFTimestamp) > 0.95f / setting_keyframesPerSecond;
+}
+
+double FullSystem::getLastKeyframeTimestamp() {
+  boost::unique_lock<boost::mutex> lock(mapMutex);
+  return allKeyFramesHistory.size() == 0 ? NAN
+                                         : allKeyFramesHistory.back()->timestamp;
+}
+
+void FullSystem::predictDepthBatch(std::vector<ImageAndExposure *> images,
+                                   std::vector<int> incomingIds) {
+  assert(images.size() == incomingIds.size());
+  if (images.size() == 0)
+    return;
+
+  std::vector<cv::Mat> rgb_images;
+  for (ImageAndExposure *img : images)
+    rgb_images.push_back(img->rgb_image);
+
+  std::vector<DepthPrediction> predictions;
+  depthPredictor->predict(incomingIds, rgb_images, predictions);
+
+  // candidates of the previous batch have all been played by now.
+  boost::unique_lock<boost::mutex> lock(depthMapCacheMutex);
+  numPrecomputedMissed += precomputedDepthMaps.size();
+  precomputedDepthMaps.clear();
+  for (unsigned int i = 0; i < incomingIds.size(); i++)
+    precomputedDepthMaps[incomingIds[i]] = predictions[i];
+}
+
+void FullSystem::depthInferenceLoop() {
+  boost::unique_lock<boost::mutex> lock(depthMapCacheMutex);
+
+  while (true) {
+    if (depthJobs.size() == 0) {
+      if (!runDepthInference)
+        break;
+      depthJobSignal.wait(lock);
+      continue;
+    }
+
+    // take whatever is queued (up to setting_depthBatchSize) into one forward pass.
+    std::vector<DepthJob> jobs;
+    while (depthJobs.size() > 0 &&
+           (int)jobs.size() < std::max(1, setting_depthBatchSize)) {
+      DepthJob job = depthJobs.front();
+      depthJobs.pop_front();
+      if (job.record)
+        numRecordJobs--;
+
+      // frame was dropped (non-KF, marginalized) before we got to it, or we
+      // are shutting down. recorded frames are still run for depthStore.
+      if (!job.record && (!runDepthInference ||
+                          depthMapCache.find(job.id) == depthMapCache.end())) {
+        job.result->set_value(DepthPrediction());
+        continue;
+      }
+      jobs.push_back(job);
+    }
+    // room in the queue for waiting recorders.
+    depthJobSignal.notify_all();
+    if (jobs.size() == 0)
+      continue;
+
+    lock.unlock();
+    std::vector<int> ids;
+    std::vector<cv::Mat> images;
+    for (DepthJob &job : jobs) {
+      ids.push_back(job.incomingId);
+      images.push_back(job.image);
+    }
+    std::vector<DepthPrediction> predictions;
+    depthPredictor->predict(ids, images, predictions);
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+      if (depthStore)
+        depthStore->write(jobs[i].incomingId, predictions[i].invdepth);
+      jobs[i].result->set_value(predictions[i]);
+    }
+    lock.lock();
+  }
 }
 
 void FullSystem::dispToDisplay(cv::Mat &disp) {
@@ -26,6 +26,9 @@
 #define MAX_ACTIVE_FRAMES 100
 
 #include <deque>
+#include <map>
+#include <memory>
+#include <future>
 #include "util/NumType.h"
 #include "util/globalCalib.h"
 #include "vector"
@@ -39,9 +42,10 @@
 #include "util/IndexThreadReduce.h"
 #include "OptimizationBackend/EnergyFunctional.h"
 #include "FullSystem/PixelSelector2.h"
+#include "util/DepthMapStore.h"
 
 #include <math.h>
-#include <monodepth2/monodepth.h>
+#include "monodepth2/DepthPredictor.h"
 
 namespace dso
 {
@@ -133,9 +137,12 @@ inline bool eigenTestNan(const MatXX &m, std::string msg)
 class FullSystem {
 public:
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-	FullSystem(const std::string &path_cnn);
+	FullSystem(std::shared_ptr<DepthPredictor> depthPredictor);
 	virtual ~FullSystem();
 
+	// drops all frames / points and starts over. keeps threads, buffers and the depth network.
+	void reset();
+
 	// adds a new frame, and creates point & residual structs.
 	void addActiveFrame(ImageAndExposure* image, int id, std::string prefix);
 
@@ -167,7 +174,18 @@ public:
 	void setGammaFunction(float* BInv);
 	void setOriginalCalib(const VecXf &originalCalib, int originalW, int originalH);
 
-	MonoDepth* depthPredictor;
+	// offline mode: runs the network on a batch of upcoming KF candidates in one
+	// forward pass. results are picked up by incoming id once the frame becomes a KF.
+	void predictDepthBatch(std::vector<ImageAndExposure*> images, std::vector<int> incomingIds);
+
+	// the fixed KF rate rule (kfps=): is a frame at [timestamp] a KF, if the last KF was
+	// at [lastKFTimestamp] (NAN if there is none)? shared with the batch planning in main.
+	static bool isKeyframeDue(double timestamp, double lastKFTimestamp);
+	// timestamp of the newest KF, NAN before the first one (and after a reset).
+	double getLastKeyframeTimestamp();
+
+	std::shared_ptr<DepthPredictor> depthPredictor;	// shared, outlives resets.
+	std::shared_ptr<DepthMapStore> depthStore;	// record all depth maps into this file. optional.
 	bool useGPU;
 
 private:
@@ -290,6 +308,7 @@ private:
 	boost::mutex coarseTrackerSwapMutex;			// if tracker sees that there is a new reference, tracker locks [coarseTrackerSwapMutex] and swaps the two.
 	CoarseTracker* coarseTracker_forNewKF;			// set as as reference. protected by [coarseTrackerSwapMutex].
 	CoarseTracker* coarseTracker;					// always used to track new frames. protected by [trackMutex].
+	IndexThreadReduce<Vec10> trackReduce;			// re-track attempts of trackNewCoarse (treadReduce belongs to the mapper).
 	float minIdJetVisTracker, maxIdJetVisTracker;
 	float minIdJetVisDebug, maxIdJetVisDebug;
 
@@ -323,9 +342,38 @@ private:
 	bool needToKetchupMapping;
 	int lastRefStopID;
 
+	// inverse depth predicted for a frame. computed at most once per frame and
+	// shared by all consumers (initializer, new traces, display).
+	// requestDepthMap() only queues the frame for the depth thread, getDepthMap() blocks.
+	std::shared_future<DepthPrediction> requestDepthMap(FrameHessian* fh);
 	cv::Mat getDepthMap(FrameHessian* fh);
+	void evictDepthMap(FrameHessian* fh);
 	void dispToDisplay(cv::Mat &disp);
 
+	// depth inference, runs ahead of the mapper so the network overlaps with tracking / optimize().
+	// All protected by [depthMapCacheMutex].
+	struct DepthJob
+	{
+		int id;
+		int incomingId;
+		cv::Mat image;
+		bool record;	// goes to depthStore: run even if the frame is evicted before.
+		std::shared_ptr<std::promise<DepthPrediction>> result;
+	};
+	void depthInferenceLoop();
+
+	// cached network outputs, keyed by FrameShell::id. entries are dropped when
+	// the frame is marginalized (or turns out not to be a KF).
+	boost::mutex depthMapCacheMutex;
+	std::map<int, std::shared_future<DepthPrediction>> depthMapCache;
+	std::map<int, DepthPrediction> precomputedDepthMaps;	// from predictDepthBatch(), keyed by FrameShell::incoming_id.
+	int numPrecomputedHit, numPrecomputedMissed;	// became a KF / did not.
+	std::deque<DepthJob> depthJobs;
+	int numRecordJobs;	// queued jobs with [record], at most setting_depthRecordQueue.
+	boost::condition_variable depthJobSignal;
+	boost::thread depthThread;
+	bool runDepthInference;
+
 };
 }
 
@@ -163,6 +163,7 @@ void FullSystem::marginalizeFrame(FrameHessian* frame)
   {
     savePoints(frame);
   }
+	evictDepthMap(frame);
 
 	ef->marginalizeFrame(frame->efFrame);
 
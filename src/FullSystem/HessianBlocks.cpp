@@ -28,6 +28,10 @@
 #include "FullSystem/ImmaturePoint.h"
 #include "OptimizationBackend/EnergyFunctionalStructs.h"
 
+#if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
+#include "SSE2NEON.h"
+#endif
+
 namespace dso
 {
 
@@ -125,69 +129,213 @@ void FrameHessian::release()
 }
 
 
-void FrameHessian::makeImages(float* color, CalibHessian* HCalib)
+// one row of the next pyramid level: 2x2 averages of the rows [r0] and [r1] above it.
+static inline void downsampleRow(const float* r0, const float* r1, float* out, int wl)
 {
-
-	for(int i=0;i<pyrLevelsUsed;i++)
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	int x=0;
+	for(;x+4<=wl;x+=4)
 	{
-		dIp[i] = new Eigen::Vector3f[wG[i]*hG[i]];
-		absSquaredGrad[i] = new float[wG[i]*hG[i]];
+		__m128 a0 = _mm_loadu_ps(r0+2*x);
+		__m128 b0 = _mm_loadu_ps(r0+2*x+4);
+		__m128 a1 = _mm_loadu_ps(r1+2*x);
+		__m128 b1 = _mm_loadu_ps(r1+2*x+4);
+
+		// same order of additions as below.
+		__m128 sum = _mm_add_ps(_mm_shuffle_ps(a0,b0,_MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(a0,b0,_MM_SHUFFLE(3,1,3,1)));
+		sum = _mm_add_ps(sum, _mm_shuffle_ps(a1,b1,_MM_SHUFFLE(2,0,2,0)));
+		sum = _mm_add_ps(sum, _mm_shuffle_ps(a1,b1,_MM_SHUFFLE(3,1,3,1)));
+		_mm_storeu_ps(out+x, _mm_mul_ps(quarter, sum));
 	}
-	dI = dIp[0];
+	for(;x<wl;x++)
+		out[x] = 0.25f * (r0[2*x] + r0[2*x+1] + r1[2*x] + r1[2*x+1]);
+}
 
+// where makeImages writes one level to; planar and padded are optional.
+struct PyramidLevelOutput
+{
+	Eigen::Vector3f* dI;
+	float* dabs;
+	float* planar[3];
+	Eigen::Vector4f* padded;
+};
 
-	// make d0
-	int w=wG[0];
-	int h=hG[0];
-	for(int i=0;i<w*h;i++)
-		dI[i][0] = color[i];
+// pixels without gradients.
+static inline void intensityOnly(const PyramidLevelOutput &out, int idx, float I)
+{
+	out.dI[idx][0] = I;
+	if(out.planar[0] != 0) out.planar[0][idx] = I;
+	if(out.padded != 0) out.padded[idx][0] = I;
+}
 
-	for(int lvl=0; lvl<pyrLevelsUsed; lvl++)
+// central differences of the row starting at [idx0] of the planar image [I] (the rows above
+// and below have to be there), written with the intensity into every layout of [out]. dabs
+// gets the squared gradient norm, times gw2[intensity] if [gw2] is given. non-finite gradients
+// become 0.
+static inline void gradientRow(const float* I, int idx0, int wl, const PyramidLevelOutput &out, const float* gw2)
+{
+	Eigen::Vector3f* dI = out.dI;
+	float* dabs = out.dabs;
+
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i cMin = _mm_set1_epi32(5), cMax = _mm_set1_epi32(250);
+	int idx=idx0, end=idx0+wl;
+	for(;idx+4<=end;idx+=4)
 	{
-		int wl = wG[lvl], hl = hG[lvl];
-		Eigen::Vector3f* dI_l = dIp[lvl];
+		__m128 c = _mm_loadu_ps(I+idx);
+		__m128 dx = _mm_mul_ps(half, _mm_sub_ps(_mm_loadu_ps(I+idx+1), _mm_loadu_ps(I+idx-1)));
+		__m128 dy = _mm_mul_ps(half, _mm_sub_ps(_mm_loadu_ps(I+idx+wl), _mm_loadu_ps(I+idx-wl)));
 
-		float* dabs_l = absSquaredGrad[lvl];
-		if(lvl>0)
-		{
-			int lvlm1 = lvl-1;
-			int wlm1 = wG[lvlm1];
-			Eigen::Vector3f* dI_lm = dIp[lvlm1];
+		// x-x is 0 only for finite x.
+		dx = _mm_and_ps(dx, _mm_cmpeq_ps(_mm_sub_ps(dx,dx), zero));
+		dy = _mm_and_ps(dy, _mm_cmpeq_ps(_mm_sub_ps(dy,dy), zero));
 
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy));
+		if(gw2 != 0)
+		{
+			// rounded and clamped like CalibHessian::getBGradOnly (NAN and INF become INT_MIN, so 5).
+			__m128i ci = _mm_cvttps_epi32(_mm_add_ps(c, half));
+			__m128i lo = _mm_cmplt_epi32(ci, cMin);
+			ci = _mm_or_si128(_mm_and_si128(lo, cMin), _mm_andnot_si128(lo, ci));
+			__m128i hi = _mm_cmpgt_epi32(ci, cMax);
+			ci = _mm_or_si128(_mm_and_si128(hi, cMax), _mm_andnot_si128(hi, ci));
+			EIGEN_ALIGN16 int cs[4];
+			_mm_store_si128((__m128i*)cs, ci);
+			d2 = _mm_mul_ps(d2, _mm_setr_ps(gw2[cs[0]], gw2[cs[1]], gw2[cs[2]], gw2[cs[3]]));
+		}
+		_mm_storeu_ps(dabs+idx, d2);
+
+		// (I, dx, dy) of 4 pixels = 3 vectors.
+		__m128 t = _mm_unpacklo_ps(c, dx);
+		__m128 p0 = _mm_shuffle_ps(t, _mm_shuffle_ps(dy, c, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,1,0));
+		__m128 p1 = _mm_shuffle_ps(_mm_shuffle_ps(dx, dy, _MM_SHUFFLE(1,1,1,1)), _mm_shuffle_ps(c, dx, _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0));
+		__m128 p2 = _mm_shuffle_ps(_mm_shuffle_ps(dy, c, _MM_SHUFFLE(3,3,2,2)), _mm_shuffle_ps(dx, dy, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+		float* dst = dI[idx].data();
+		_mm_storeu_ps(dst, p0);
+		_mm_storeu_ps(dst+4, p1);
+		_mm_storeu_ps(dst+8, p2);
+
+		if(out.planar[0] != 0)
+		{
+			_mm_storeu_ps(out.planar[0]+idx, c);
+			_mm_storeu_ps(out.planar[1]+idx, dx);
+			_mm_storeu_ps(out.planar[2]+idx, dy);
+		}
+		if(out.padded != 0)
+		{
+			__m128 r0 = c, r1 = dx, r2 = dy, r3 = zero;
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			float* pd = out.padded[idx].data();
+			_mm_store_ps(pd, r0);
+			_mm_store_ps(pd+4, r1);
+			_mm_store_ps(pd+8, r2);
+			_mm_store_ps(pd+12, r3);
+		}
+	}
+	for(;idx<end;idx++)
+	{
+		float dx = 0.5f*(I[idx+1] - I[idx-1]);
+		float dy = 0.5f*(I[idx+wl] - I[idx-wl]);
 
+		if(!std::isfinite(dx)) dx=0;
+		if(!std::isfinite(dy)) dy=0;
 
-			for(int y=0;y<hl;y++)
-				for(int x=0;x<wl;x++)
-				{
-					dI_l[x + y*wl][0] = 0.25f * (dI_lm[2*x   + 2*y*wlm1][0] +
-												dI_lm[2*x+1 + 2*y*wlm1][0] +
-												dI_lm[2*x   + 2*y*wlm1+wlm1][0] +
-												dI_lm[2*x+1 + 2*y*wlm1+wlm1][0]);
-				}
+		dI[idx][0] = I[idx];
+		dI[idx][1] = dx;
+		dI[idx][2] = dy;
+		if(out.planar[0] != 0)
+		{
+			out.planar[0][idx] = I[idx];
+			out.planar[1][idx] = dx;
+			out.planar[2][idx] = dy;
 		}
+		if(out.padded != 0)
+			out.padded[idx] = Eigen::Vector4f(I[idx], dx, dy, 0);
 
-		for(int idx=wl;idx < wl*(hl-1);idx++)
+		dabs[idx] = dx*dx+dy*dy;
+		if(gw2 != 0)
 		{
-			float dx = 0.5f*(dI_l[idx+1][0] - dI_l[idx-1][0]);
-			float dy = 0.5f*(dI_l[idx+wl][0] - dI_l[idx-wl][0]);
+			int c = I[idx]+0.5f;
+			if(c<5) c=5;
+			if(c>250) c=250;
+			dabs[idx] *= gw2[c];
+		}
+	}
+}
+
+void FrameHessian::makeImages(float* color, CalibHessian* HCalib)
+{
+
+	for(int i=0;i<pyrLevelsUsed;i++)
+	{
+		dIp[i] = BufferPool::instance().get<Eigen::Vector3f>(wG[i]*hG[i]);
+		absSquaredGrad[i] = BufferPool::instance().get<float>(wG[i]*hG[i]);
+		if(setting_pyramidLayout == 1)
+			for(int c=0;c<3;c++)
+				dIpPlanar[i][c] = BufferPool::instance().get<float>(wG[i]*hG[i]);
+		if(setting_pyramidLayout == 2)
+			dIpPadded[i] = BufferPool::instance().get<Eigen::Vector4f>(wG[i]*hG[i]);
+	}
+	dI = dIp[0];
 
 
-			if(!std::isfinite(dx)) dx=0;
-			if(!std::isfinite(dy)) dy=0;
+	// squared gradient of the response, to convert gradients to the original color space
+	// (before removing response), see getBGradOnly.
+	float gw2[256];
+	const float* gw2_p = 0;
+	if(setting_gammaWeightsPixelSelect==1 && HCalib!=0)
+	{
+		for(int c=5;c<=250;c++)
+		{
+			float gw = HCalib->getBGradOnly((float)c);
+			gw2[c] = gw*gw;
+		}
+		gw2_p = gw2;
+	}
 
-			dI_l[idx][1] = dx;
-			dI_l[idx][2] = dy;
 
+	// planar intensities of the levels, level 0 is [color] itself; the others alternate
+	// between two pooled buffers. each level is made row by row, with its gradients one
+	// row behind, so everything is read while it is still in cache.
+	float* planar[2] = {0,0};
+	int planarSize = pyrLevelsUsed > 1 ? wG[1]*hG[1] : 0;
+	if(planarSize > 0)
+	{
+		planar[0] = BufferPool::instance().get<float>(planarSize);
+		planar[1] = BufferPool::instance().get<float>(planarSize);
+	}
 
-			dabs_l[idx] = dx*dx+dy*dy;
+	const float* I_lm = 0;
+	for(int lvl=0; lvl<pyrLevelsUsed; lvl++)
+	{
+		int wl = wG[lvl], hl = hG[lvl];
+		PyramidLevelOutput out;
+		out.dI = dIp[lvl];
+		out.dabs = absSquaredGrad[lvl];
+		for(int c=0;c<3;c++) out.planar[c] = dIpPlanar[lvl][c];
+		out.padded = dIpPadded[lvl];
+		float* I_l = lvl==0 ? color : planar[lvl&1];
+		int wlm1 = lvl>0 ? wG[lvl-1] : 0;
+
+		for(int y=0;y<hl;y++)
+		{
+			if(lvl>0) downsampleRow(I_lm + 2*y*wlm1, I_lm + (2*y+1)*wlm1, I_l + y*wl, wl);
+			if(y>=2) gradientRow(I_l, (y-1)*wl, wl, out, gw2_p);
+		}
 
-			if(setting_gammaWeightsPixelSelect==1 && HCalib!=0)
-			{
-				float gw = HCalib->getBGradOnly((float)(dI_l[idx][0]));
-				dabs_l[idx] *= gw*gw;	// convert to gradient of original color space (before removing response).
-			}
+		// the first and the last row have no gradients.
+		for(int x=0;x<wl;x++)
+		{
+			intensityOnly(out, x, I_l[x]);
+			intensityOnly(out, x+(hl-1)*wl, I_l[x+(hl-1)*wl]);
 		}
+
+		I_lm = I_l;
 	}
+
+	BufferPool::instance().release(planar[0], planarSize);
+	BufferPool::instance().release(planar[1], planarSize);
 }
 
 void FrameFramePrecalc::set(FrameHessian* host, FrameHessian* target, CalibHessian* HCalib )
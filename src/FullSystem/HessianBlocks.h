@@ -33,6 +33,7 @@
 #include <fstream>
 #include "util/NumType.h"
 #include "FullSystem/Residuals.h"
+#include "FullSystem/PyramidLevel.h"
 #include "util/ImageAndExposure.h"
 #include <opencv2/opencv.hpp>
 
@@ -120,6 +121,9 @@ struct FrameHessian
 	Eigen::Vector3f* dI;				 // trace, fine tracking. Used for direction select (not for gradient histograms etc.)
 	Eigen::Vector3f* dIp[PYR_LEVELS];	 // coarse tracking / coarse initializer. NAN in [0] only.
 	float* absSquaredGrad[PYR_LEVELS];   // only used for pixel select (histograms etc.). no NAN.
+	// dIp once more, in the layout of setting_pyramidLayout (0 if that is 0).
+	float* dIpPlanar[PYR_LEVELS][3];	 // 1: I, dx, dy as separate images.
+	Eigen::Vector4f* dIpPadded[PYR_LEVELS]; // 2: (I, dx, dy, 0) per pixel.
 
 	float* intensity;
 
@@ -237,10 +241,13 @@ struct FrameHessian
 		release(); instanceCounter--;
 		for(int i=0;i<pyrLevelsUsed;i++)
 		{
-			delete[] dIp[i];
-			delete[]  absSquaredGrad[i];
-
+			BufferPool::instance().release(dIp[i], wG[i]*hG[i]);
+			BufferPool::instance().release(absSquaredGrad[i], wG[i]*hG[i]);
+			for(int c=0;c<3;c++)
+				BufferPool::instance().release(dIpPlanar[i][c], wG[i]*hG[i]);
+			BufferPool::instance().release(dIpPadded[i], wG[i]*hG[i]);
 		}
+		BufferPool::instance().releaseMat(rgb_image);
 
 
 
@@ -254,7 +261,13 @@ struct FrameHessian
 		efFrame = 0;
 		frameEnergyTH = 8*8*patternNum;
 
-
+		for(int i=0;i<PYR_LEVELS;i++)
+		{
+			dIp[i] = 0;
+			absSquaredGrad[i] = 0;
+			dIpPlanar[i][0] = dIpPlanar[i][1] = dIpPlanar[i][2] = 0;
+			dIpPadded[i] = 0;
+		}
 
 		debugImage=0;
 	};
@@ -262,6 +275,18 @@ struct FrameHessian
 
     void makeImages(float* color, CalibHessian* HCalib);
 
+	// level [lvl] of the pyramid, in the best layout there is.
+	inline PyramidLevel level(int lvl) const
+	{
+		PyramidLevel l;
+		l.aos = dIp[lvl];
+		for(int c=0;c<3;c++) l.planar[c] = dIpPlanar[lvl][c];
+		l.padded = dIpPadded[lvl];
+		l.w = wG[lvl];
+		l.h = hG[lvl];
+		return l;
+	}
+
 	inline Vec10 getPrior()
 	{
 		Vec10 p =  Vec10::Zero();
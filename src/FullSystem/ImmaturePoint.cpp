@@ -254,6 +254,7 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,const Mat33f &hos
 
 
 
+	const PyramidLevel frameLevel = frame->level(0);
 	float errors[100];
 	float bestU=0, bestV=0, bestEnergy=1e10;
 	int bestIdx=-1;
@@ -264,10 +265,9 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,const Mat33f &hos
 		float energy=0;
 		for(int idx=0;idx<patternNum;idx++)
 		{
-			float hitColor = getInterpolatedElement31(frame->dI,
+			float hitColor = frameLevel.interpolateIntensity(
 										(float)(ptx+rotatetPattern[idx][0]),
-										(float)(pty+rotatetPattern[idx][1]),
-										wG[0]);
+										(float)(pty+rotatetPattern[idx][1]));
 
 			if(!std::isfinite(hitColor)) {energy+=1e5; continue;}
 			float residual = hitColor - (float)(hostToFrame_affine[0] * color[idx] + hostToFrame_affine[1]);
@@ -311,9 +311,9 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,const Mat33f &hos
 		float H = 1, b=0, energy=0;
 		for(int idx=0;idx<patternNum;idx++)
 		{
-			Vec3f hitColor = getInterpolatedElement33(frame->dI,
+			Vec3f hitColor = frameLevel.interpolate(
 					(float)(bestU+rotatetPattern[idx][0]),
-					(float)(bestV+rotatetPattern[idx][1]),wG[0]);
+					(float)(bestV+rotatetPattern[idx][1]));
 
 			if(!std::isfinite((float)hitColor[0])) {energy+=1e5; continue;}
 			float residual = hitColor[0] - (hostToFrame_affine[0] * color[idx] + hostToFrame_affine[1]);
@@ -445,7 +445,7 @@ float ImmaturePoint::calcResidual(
 	FrameFramePrecalc* precalc = &(host->targetPrecalc[tmpRes->target->idx]);
 
 	float energyLeft=0;
-	const Eigen::Vector3f* dIl = tmpRes->target->dI;
+	const PyramidLevel dIl = tmpRes->target->level(0);
 	const Mat33f &PRE_KRKiTll = precalc->PRE_KRKiTll;
 	const Vec3f &PRE_KtTll = precalc->PRE_KtTll;
 	Vec2f affLL = precalc->PRE_aff_mode;
@@ -456,7 +456,7 @@ float ImmaturePoint::calcResidual(
 		if(!projectPoint(this->u+patternP[idx][0], this->v+patternP[idx][1], idepth, PRE_KRKiTll, PRE_KtTll, Ku, Kv))
 			{return 1e10;}
 
-		Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
+		Vec3f hitColor = dIl.interpolate(Ku, Kv);
 		if(!std::isfinite((float)hitColor[0])) {return 1e10;}
 		//if(benchmarkSpecialOption==5) hitColor = (getInterpolatedElement13BiCub(tmpRes->target->I, Ku, Kv, wG[0]));
 
@@ -490,7 +490,7 @@ double ImmaturePoint::linearizeResidual(
 	// check OOB due to scale angle change.
 
 	float energyLeft=0;
-	const Eigen::Vector3f* dIl = tmpRes->target->dI;
+	const PyramidLevel dIl = tmpRes->target->level(0);
 	const Mat33f &PRE_RTll = precalc->PRE_RTll;
 	const Vec3f &PRE_tTll = precalc->PRE_tTll;
 	//const float * const Il = tmpRes->target->I;
@@ -511,7 +511,7 @@ double ImmaturePoint::linearizeResidual(
 			{tmpRes->state_NewState = ResState::OOB; return tmpRes->state_energy;}
 
 
-		Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
+		Vec3f hitColor = dIl.interpolate(Ku, Kv);
 
 		if(!std::isfinite((float)hitColor[0])) {tmpRes->state_NewState = ResState::OOB; return tmpRes->state_energy;}
 		float residual = hitColor[0] - (affLL[0] * color[idx] + affLL[1]);
@@ -63,6 +63,13 @@ PixelSelector::~PixelSelector()
 	delete[] thsSmoothed;
 }
 
+void PixelSelector::reset()
+{
+	currentPotential=3;
+	allowFast=false;
+	gradHistFrame=0;
+}
+
 int computeHistQuantil(int* hist, float below)
 {
 	int th = hist[0]*below+0.5f;
@@ -44,6 +44,7 @@ public:
 
 	PixelSelector(int w, int h);
 	~PixelSelector();
+	void reset();
 	int currentPotential;
 
 
@@ -0,0 +1,121 @@
+/**
+* This file is part of DSO.
+* 
+* Copyright 2016 Technical University of Munich and Intel.
+* Developed by Jakob Engel <engelj at in dot tum dot de>,
+* for more information see <http://vision.in.tum.de/dso>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* DSO is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* DSO is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with DSO. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "util/NumType.h"
+#include "util/globalFuncs.h"
+
+#if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
+#include "SSE2NEON.h"
+#endif
+
+namespace dso
+{
+
+// one level of the (I, dx, dy) pyramid of a frame (FrameHessian::level), in the layout
+// it is kept in besides dIp (setting_pyramidLayout). the interpolation is always
+// the one of getInterpolatedElement33.
+struct PyramidLevel
+{
+	const Eigen::Vector3f* aos;		// (I, dx, dy) per pixel, always there.
+	const float* planar[3];			// I, dx, dy as separate images, or 0.
+	const Eigen::Vector4f* padded;	// (I, dx, dy, 0) per pixel, 16-byte aligned, or 0.
+	int w, h;
+
+	// channel [c] of pixel i is at channel(c)[i*stride()]; the fastest layout there is.
+	inline const float* channel(int c) const
+	{
+		if(planar[0] != 0) return planar[c];
+		if(padded != 0) return padded[0].data()+c;
+		return aos[0].data()+c;
+	}
+	inline int stride() const {return planar[0] != 0 ? 1 : (padded != 0 ? 4 : 3);}
+
+	EIGEN_ALWAYS_INLINE Eigen::Vector3f interpolate(const float x, const float y) const
+	{
+		if(padded != 0)
+		{
+			int ix = (int)x;
+			int iy = (int)y;
+			float dx = x - ix;
+			float dy = y - iy;
+			float dxdy = dx*dy;
+			const float* bp = padded[ix+iy*w].data();
+
+			// one aligned load per tap.
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(dxdy), _mm_load_ps(bp+4+4*w)),
+					_mm_mul_ps(_mm_set1_ps(dy-dxdy), _mm_load_ps(bp+4*w))),
+					_mm_mul_ps(_mm_set1_ps(dx-dxdy), _mm_load_ps(bp+4))),
+					_mm_mul_ps(_mm_set1_ps(1-dx-dy+dxdy), _mm_load_ps(bp)));
+			EIGEN_ALIGN16 float res[4];
+			_mm_store_ps(res, r);
+			return Eigen::Vector3f(res[0], res[1], res[2]);
+		}
+
+		if(planar[0] != 0)
+		{
+			int ix = (int)x;
+			int iy = (int)y;
+			float dx = x - ix;
+			float dy = y - iy;
+			float dxdy = dx*dy;
+			int i = ix+iy*w;
+
+			float w11 = dxdy, w01 = dy-dxdy, w10 = dx-dxdy, w00 = 1-dx-dy+dxdy;
+			Eigen::Vector3f res;
+			for(int c=0;c<3;c++)
+			{
+				const float* bp = planar[c]+i;
+				res[c] = w11*bp[1+w] + w01*bp[w] + w10*bp[1] + w00*bp[0];
+			}
+			return res;
+		}
+
+		return getInterpolatedElement33(aos, x, y, w);
+	}
+
+	// the intensity only (getInterpolatedElement31).
+	EIGEN_ALWAYS_INLINE float interpolateIntensity(const float x, const float y) const
+	{
+		if(planar[0] != 0) return getInterpolatedElement(planar[0], x, y, w);
+		if(padded != 0)
+		{
+			int ix = (int)x;
+			int iy = (int)y;
+			float dx = x - ix;
+			float dy = y - iy;
+			float dxdy = dx*dy;
+			const Eigen::Vector4f* bp = padded+ix+iy*w;
+			return dxdy * bp[1+w][0]
+					+ (dy-dxdy) * bp[w][0]
+					+ (dx-dxdy) * bp[1][0]
+					+ (1-dx-dy+dxdy) * bp[0][0];
+		}
+		return getInterpolatedElement31(aos, x, y, w);
+	}
+};
+
+}
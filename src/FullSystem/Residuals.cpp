@@ -84,7 +84,7 @@ double PointFrameResidual::linearize(CalibHessian* HCalib)
 
 	FrameFramePrecalc* precalc = &(host->targetPrecalc[target->idx]);
 	float energyLeft=0;
-	const Eigen::Vector3f* dIl = target->dI;
+	const PyramidLevel dIl = target->level(0);
 	//const float* const Il = target->I;
 	const Mat33f &PRE_KRKiTll = precalc->PRE_KRKiTll;
 	const Vec3f &PRE_KtTll = precalc->PRE_KtTll;
@@ -190,7 +190,7 @@ double PointFrameResidual::linearize(CalibHessian* HCalib)
 		projectedTo[idx][1] = Kv;
 
 
-        Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
+        Vec3f hitColor = dIl.interpolate(Ku, Kv);
         float residual = hitColor[0] - (float)(affLL[0] * color[idx] + affLL[1]);
 
 
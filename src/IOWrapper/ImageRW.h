@@ -33,12 +33,13 @@ namespace IOWrap
 {
 
 MinimalImageB* readImageBW_8U(std::string filename);
-cv::Mat readImageRGB_8U(std::string filename);
+// BGR. [reduction] 2, 4 or 8: decoded at that fraction of the resolution (DCT scaling for JPEG).
+cv::Mat readImageRGB_8U(std::string filename, int reduction=1);
 MinimalImage<unsigned short>* readImageBW_16U(std::string filename);
 
 
 MinimalImageB* readStreamBW_8U(char* data, int numBytes);
-cv::Mat readStreamRGB_8U(char* data, int numBytes);
+cv::Mat readStreamRGB_8U(char* data, int numBytes, int reduction=1);
 
 void writeImage(std::string filename, MinimalImageB* img);
 void writeImage(std::string filename, MinimalImageB3* img);
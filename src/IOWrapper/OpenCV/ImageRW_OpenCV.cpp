@@ -50,9 +50,17 @@ MinimalImageB* readImageBW_8U(std::string filename)
 	return img;
 }
 
-cv::Mat readImageRGB_8U(std::string filename)
+static int colorReadFlags(int reduction)
 {
-	cv::Mat m = cv::imread(filename, cv::IMREAD_COLOR);
+	if(reduction == 2) return cv::IMREAD_REDUCED_COLOR_2;
+	if(reduction == 4) return cv::IMREAD_REDUCED_COLOR_4;
+	if(reduction == 8) return cv::IMREAD_REDUCED_COLOR_8;
+	return cv::IMREAD_COLOR;
+}
+
+cv::Mat readImageRGB_8U(std::string filename, int reduction)
+{
+	cv::Mat m = cv::imread(filename, colorReadFlags(reduction));
 	if(m.rows*m.cols==0)
 	{
 		printf("cv::imread could not read image %s! this may segfault. \n", filename.c_str());
@@ -102,17 +110,17 @@ MinimalImageB* readStreamBW_8U(char* data, int numBytes)
 	return img;
 }
 
-cv::Mat readStreamRGB_8U(char *data, int numBytes) {
+cv::Mat readStreamRGB_8U(char *data, int numBytes, int reduction) {
   cv::Mat m = cv::imdecode(
-      cv::Mat(numBytes, 3, CV_8U, data),
-      cv::IMREAD_COLOR); // This is where the color image is being read in
+      cv::Mat(1, numBytes, CV_8U, data),
+      colorReadFlags(reduction)); // This is where the color image is being read in
   if (m.rows * m.cols == 0) {
     printf(
         "cv::imdecode could not read stream (%d bytes)! this may segfault. \n",
         numBytes);
     exit(0);
   }
-  if (m.type() != CV_8U) {
+  if (m.type() != CV_8UC3) {
     printf("cv::imdecode did something strange! this may segfault. \n");
     exit(0);
   }
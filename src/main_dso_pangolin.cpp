@@ -51,18 +51,28 @@ std::string gammaCalib = "";
 std::string source = "";
 std::string calib = "";
 std::string cnn = "";
+std::string depthRecordFile = "";
+std::string depthReplayFile = "";
+std::string depthBackend = "torch";
 
 double rescale = 1;
 bool reverse_image = false;
 bool disableROS = false;
 int start = 0;
 int end_img = 100000;
+int videoDecimation = 1; // files=<video>: only every n-th frame is used.
 bool prefetch = false;
+bool useManifest = true; // image folders / .zip: cache the file list in a manifest.
 float playbackSpeed =
     0; // 0 for linearize (play as fast as possible, while sequentializing
        // tracking & mapping). otherwise, factor on timestamps.
 bool preload = false;
 bool useSampleOutput = false;
+int depthBatch = 1;
+int cnnThreads = -1; // -1: whatever the optimizer backend leaves free.
+bool cnnUseGPU = true;
+std::string cnnPrecision = "fp32";
+float cnnScale = 1;
 
 int dso_mode = 0;
 
@@ -225,6 +235,25 @@ void parseArgument(char *arg) {
     printf("END AT %d!\n", end_img);
     return;
   }
+  if (1 == sscanf(arg, "pyrlayout=%d", &option)) {
+    if (option >= 0 && option <= 2) {
+      setting_pyramidLayout = option;
+      printf("PYRAMID LAYOUT %d (0: AoS only, 1: + planar, 2: + padded)!\n", option);
+    }
+    return;
+  }
+  if (1 == sscanf(arg, "manifest=%d", &option)) {
+    if (option == 0) {
+      useManifest = false;
+      printf("NOT USING A SEQUENCE MANIFEST!\n");
+    }
+    return;
+  }
+  if (1 == sscanf(arg, "decimate=%d", &option)) {
+    videoDecimation = option;
+    printf("USING EVERY %d-TH VIDEO FRAME!\n", videoDecimation);
+    return;
+  }
 
   if (1 == sscanf(arg, "files=%s", buf)) {
     source = buf;
@@ -268,6 +297,25 @@ void parseArgument(char *arg) {
     return;
   }
 
+  if (1 == sscanf(arg, "kfps=%f", &foption)) {
+    setting_keyframesPerSecond = foption;
+    printf("FIXED KF RATE %f KF/s!\n", setting_keyframesPerSecond);
+    return;
+  }
+
+  if (1 == sscanf(arg, "depthqueue=%d", &option)) {
+    setting_depthRecordQueue = option < 1 ? 1 : option;
+    printf("DEPTH RECORD QUEUE %d!\n", setting_depthRecordQueue);
+    return;
+  }
+
+  if (1 == sscanf(arg, "depthbatch=%d", &option)) {
+    depthBatch = option < 1 ? 1 : option;
+    setting_depthBatchSize = depthBatch;
+    printf("DEPTH BATCH SIZE %d!\n", depthBatch);
+    return;
+  }
+
   if (1 == sscanf(arg, "save=%d", &option)) {
     if (option == 1) {
       debugSaveImages = true;
@@ -293,6 +341,49 @@ void parseArgument(char *arg) {
     return;
   }
 
+  if (1 == sscanf(arg, "cnngpu=%d", &option)) {
+    cnnUseGPU = option == 1;
+    printf("DEPTH NETWORK ON %s!\n", cnnUseGPU ? "GPU" : "CPU");
+    return;
+  }
+
+  if (1 == sscanf(arg, "cnnprecision=%s", buf)) {
+    cnnPrecision = buf;
+    printf("DEPTH NETWORK PRECISION %s!\n", cnnPrecision.c_str());
+    return;
+  }
+
+  if (1 == sscanf(arg, "cnnscale=%f", &foption)) {
+    cnnScale = foption;
+    printf("DEPTH NETWORK AT %f x IMAGE SIZE!\n", cnnScale);
+    return;
+  }
+
+  if (1 == sscanf(arg, "cnnthreads=%d", &option)) {
+    cnnThreads = option;
+    printf("DEPTH NETWORK THREADS %d!\n", cnnThreads);
+    return;
+  }
+
+  if (1 == sscanf(arg, "depthbackend=%s", buf)) {
+    depthBackend = buf;
+    printf("DEPTH BACKEND %s!\n", depthBackend.c_str());
+    return;
+  }
+
+  if (1 == sscanf(arg, "savedepth=%s", buf)) {
+    depthRecordFile = buf;
+    printf("saving depth maps to %s!\n", depthRecordFile.c_str());
+    return;
+  }
+
+  if (1 == sscanf(arg, "loaddepth=%s", buf)) {
+    depthReplayFile = buf;
+    depthBackend = "replay";
+    printf("replaying depth maps from %s!\n", depthReplayFile.c_str());
+    return;
+  }
+
   if (1 == sscanf(arg, "mode=%d", &option)) {
 
     dso_mode = option;
@@ -329,8 +420,8 @@ int main(int argc, char **argv) {
   // hook crtl+C.
   boost::thread exThread = boost::thread(exitThread);
 
-  ImageFolderReader *reader =
-      new ImageFolderReader(source, calib, gammaCalib, vignette);
+  DatasetReader *reader = createDatasetReader(
+      source, calib, gammaCalib, vignette, videoDecimation, useManifest);
   reader->setGlobalCalibration(outputs_folder);
 
   if (setting_photometricCalibration > 0 &&
@@ -352,7 +443,40 @@ int main(int argc, char **argv) {
     linc = -1;
   }
 
-  FullSystem *fullSystem = new FullSystem(cnn);
+  if (depthRecordFile != "" && depthBackend == "replay") {
+    printf("ERROR: savedepth and loaddepth can't be used together!\n");
+    exit(1);
+  }
+
+  std::shared_ptr<DepthMapStore> depthStore;
+  if (depthRecordFile != "") {
+    depthStore.reset(
+        DepthMapStore::createWriter(depthRecordFile, wG[0], hG[0]));
+    if (!depthStore)
+      exit(1);
+  }
+
+  // loaded once, survives FullSystem resets. when replaying depth maps, the
+  // network is only loaded if explicitly given (as fallback for missing maps).
+  // NUM_THREADS cores are taken by treadReduce during optimize().
+  if (cnnThreads < 0)
+    cnnThreads =
+        std::max(1, (int)std::thread::hardware_concurrency() - NUM_THREADS);
+  DepthPredictorOptions depthOptions;
+  depthOptions.model_file = cnn;
+  depthOptions.use_gpu = cnnUseGPU;
+  depthOptions.num_threads = cnnThreads;
+  depthOptions.precision = cnnPrecision;
+  depthOptions.scale = cnnScale;
+  depthOptions.replay_file = depthReplayFile;
+  depthOptions.width = wG[0];
+  depthOptions.height = hG[0];
+  std::shared_ptr<DepthPredictor> depthPredictor =
+      createDepthPredictor(depthBackend, depthOptions);
+  printf("DEPTH FROM %s BACKEND\n", depthPredictor->name().c_str());
+
+  FullSystem *fullSystem = new FullSystem(depthPredictor);
+  fullSystem->depthStore = depthStore;
   fullSystem->setGammaFunction(reader->getPhotometricGamma());
   fullSystem->linearizeOperation = (playbackSpeed == 0);
 
@@ -392,8 +516,26 @@ int main(int argc, char **argv) {
         int i = idsToPlay[ii];
         preloadedImages.push_back(reader->getImage(i));
       }
+    } else if (prefetch) {
+      // decode + undistort the next images in the background, in play order
+      // (so reverse / start / end are handled by idsToPlay).
+      reader->startPrefetch(idsToPlay);
     }
 
+    // offline with a fixed KF rate, which frames become KFs only depends on
+    // the timestamps (FullSystem::isKeyframeDue). predict the next [depthBatch]
+    // of them from the last actual KF and run the depth network on them at once.
+    bool batchDepth = depthBatch > 1 && playbackSpeed == 0 &&
+                      setting_keyframesPerSecond > 0 &&
+                      depthBackend != "replay";
+    if (depthBatch > 1 && !batchDepth)
+      printf("depthbatch=%d: KFs can only be predicted offline (speed=0) with a "
+             "fixed KF rate (kfps=..), batching queued KFs only.\n",
+             depthBatch);
+
+    int depthPlannedUntil = -1; // last index into idsToPlay of the last batch.
+    std::map<int, ImageAndExposure *> readAhead;
+
     struct timeval tv_start;
     gettimeofday(&tv_start, NULL);
     clock_t started = clock();
@@ -409,11 +551,46 @@ int main(int argc, char **argv) {
 
       int i = idsToPlay[ii];
 
+      if (batchDepth && ii > depthPlannedUntil) {
+        std::vector<ImageAndExposure *> batchImages;
+        std::vector<int> batchIds;
+        double lastKFTime = fullSystem->getLastKeyframeTimestamp();
+        int jj = ii;
+        for (; jj < (int)idsToPlay.size() &&
+               (int)batchImages.size() < depthBatch;
+             jj++) {
+          double ts = reader->getTimestamp(idsToPlay[jj]);
+          if (!FullSystem::isKeyframeDue(ts, lastKFTime))
+            continue;
+          lastKFTime = ts;
+          ImageAndExposure *candidate;
+          if (preload)
+            candidate = preloadedImages[jj];
+          else if (readAhead.count(jj)) // planned before a reset.
+            candidate = readAhead[jj];
+          else
+            candidate = readAhead[jj] = reader->getImage(idsToPlay[jj]);
+          if (candidate == 0) // past the end of a video.
+            break;
+          batchImages.push_back(candidate);
+          batchIds.push_back(idsToPlay[jj]);
+        }
+        depthPlannedUntil = jj - 1;
+        fullSystem->predictDepthBatch(batchImages, batchIds);
+      }
+
       ImageAndExposure *img;
       if (preload)
         img = preloadedImages[ii];
-      else
+      else if (readAhead.count(ii)) {
+        img = readAhead[ii];
+        readAhead.erase(ii);
+      } else
         img = reader->getImage(i);
+      if (img == 0) {
+        printf("no image %d, end of the sequence.\n", i);
+        break;
+      }
         std::string file_prefix = reader->getImagePrefix(i);
 
       bool skipFrame = false;
@@ -446,19 +623,12 @@ int main(int argc, char **argv) {
         if (ii < 250 || setting_fullResetRequested) {
           printf("RESETTING!\n");
 
-          std::vector<IOWrap::Output3DWrapper *> wraps =
-              fullSystem->outputWrapper;
-          delete fullSystem;
+          fullSystem->reset();
+          depthPlannedUntil = ii; // re-plan from the next frame on.
 
-          for (IOWrap::Output3DWrapper *ow : wraps)
+          for (IOWrap::Output3DWrapper *ow : fullSystem->outputWrapper)
             ow->reset();
 
-          fullSystem = new FullSystem(cnn);
-          fullSystem->setGammaFunction(reader->getPhotometricGamma());
-          fullSystem->linearizeOperation = (playbackSpeed == 0);
-
-          fullSystem->outputWrapper = wraps;
-
           setting_fullResetRequested = false;
         }
       }
@@ -468,6 +638,9 @@ int main(int argc, char **argv) {
         break;
       }
     }
+    for (auto &it : readAhead)
+      delete it.second;
+    reader->stopPrefetch();
     fullSystem->blockUntilMappingIsFinished();
     clock_t ended = clock();
     struct timeval tv_end;
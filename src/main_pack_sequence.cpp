@@ -0,0 +1,143 @@
+
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// packs a sequence into one .dsopack file (see util/PackedSequence.h):
+// decoded, undistorted and photometrically corrected once, then mapped by
+// dso_dataset files=<out>.dsopack on every run.
+//
+// dso_pack files=<images|zip|video> calib=.. [gamma=.. vignette=..]
+//          out=<file>.dsopack [mode=0|1|2] [preset=2] [rgb=0] [decimate=N]
+// mode and preset have to match what dso_dataset runs with later (photometric
+// calibration and image size are baked into the file).
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/DatasetReader.h"
+#include "util/PackedSequence.h"
+#include "util/settings.h"
+
+using namespace dso;
+
+std::string source = "";
+std::string calib = "";
+std::string gammaCalib = "";
+std::string vignette = "";
+std::string outFile = "";
+bool withRGB = true;
+int videoDecimation = 1;
+
+void parseArgument(char *arg) {
+  int option;
+  char buf[1000];
+
+  if (1 == sscanf(arg, "files=%s", buf)) {
+    source = buf;
+    return;
+  }
+  if (1 == sscanf(arg, "calib=%s", buf)) {
+    calib = buf;
+    return;
+  }
+  if (1 == sscanf(arg, "gamma=%s", buf)) {
+    gammaCalib = buf;
+    return;
+  }
+  if (1 == sscanf(arg, "vignette=%s", buf)) {
+    vignette = buf;
+    return;
+  }
+  if (1 == sscanf(arg, "out=%s", buf)) {
+    outFile = buf;
+    return;
+  }
+  if (1 == sscanf(arg, "rgb=%d", &option)) {
+    withRGB = option == 1;
+    return;
+  }
+  if (1 == sscanf(arg, "decimate=%d", &option)) {
+    videoDecimation = option;
+    return;
+  }
+  if (1 == sscanf(arg, "mode=%d", &option)) {
+    // same as dso_dataset: only mode=0 uses the photometric calibration.
+    if (option == 1 || option == 2)
+      setting_photometricCalibration = 0;
+    return;
+  }
+  if (1 == sscanf(arg, "preset=%d", &option)) {
+    // same as dso_dataset: the fast presets run at 424 x 320.
+    if (option == 2 || option == 3) {
+      benchmarkSetting_width = 424;
+      benchmarkSetting_height = 320;
+    }
+    return;
+  }
+
+  printf("could not parse argument \"%s\"!!!!\n", arg);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++)
+    parseArgument(argv[i]);
+
+  if (source == "" || outFile == "") {
+    printf("usage: dso_pack files=.. calib=.. [gamma=.. vignette=..] "
+           "out=<file>.dsopack [mode=0|1|2] [preset=N] [rgb=0|1] "
+           "[decimate=N]\n");
+    return 1;
+  }
+
+  DatasetReader *reader = createDatasetReader(source, calib, gammaCalib,
+                                              vignette, videoDecimation);
+
+  Eigen::Matrix3f K;
+  int w, h;
+  reader->getCalibMono(K, w, h);
+  PackedSequence *pack = PackedSequence::createWriter(
+      outFile, w, h, withRGB, K, reader->getPhotometricGamma());
+  if (pack == 0)
+    return 1;
+
+  std::vector<int> ids;
+  for (int i = 0; i < reader->getNumImages(); i++)
+    ids.push_back(i);
+  reader->startPrefetch(ids, 16, 4);
+
+  for (int i = 0; i < (int)ids.size(); i++) {
+    ImageAndExposure *img = reader->getImage(i);
+    if (img == 0) // past the end of a video.
+      break;
+    pack->write(img, reader->getImagePrefix(i));
+    delete img;
+
+    if (i % 100 == 0)
+      printf("packed %d / %d images\n", i, (int)ids.size());
+  }
+
+  reader->stopPrefetch();
+  delete pack;
+  delete reader;
+  return 0;
+}
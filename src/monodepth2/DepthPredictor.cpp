@@ -0,0 +1,179 @@
+#include "DepthPredictor.h"
+
+#include "util/DepthMapStore.h"
+#ifdef HAS_TORCH
+#include "monodepth.h"
+#endif
+#ifdef HAS_ONNXRUNTIME
+#include "OnnxDepth.h"
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace dso
+{
+    /// Inverse depth from a file written by an earlier run (savedepth=), see DepthMapStore.
+    /// Frames missing from the file, or stored at a different size than the image, go to
+    /// [fallback], if there is one.
+    class ReplayDepthPredictor : public DepthPredictor
+    {
+        public:
+            ReplayDepthPredictor(std::shared_ptr<DepthMapStore> store, std::shared_ptr<DepthPredictor> fallback) : store_(store), fallback_(fallback) {}
+
+            void predict(const std::vector<int>& ids, std::vector<cv::Mat>& images, std::vector<DepthPrediction>& predictions) override
+            {
+                predictions.resize(ids.size());
+                std::vector<int> missing, missingIds;
+                std::vector<cv::Mat> missingImages;
+                for (unsigned int i = 0; i < ids.size(); i++)
+                {
+                    predictions[i].invdepth = store_->read(ids[i]);
+                    // consumers index the map with the image size, never hand out one that doesn't match.
+                    if (!predictions[i].invdepth.empty() && predictions[i].invdepth.size() == images[i].size())
+                        continue;
+                    if (!predictions[i].invdepth.empty() && !fallback_)
+                    {
+                        printf("depth map for image %d in the replay file is %d x %d, but the image is %d x %d, and no network loaded!\n",
+                               ids[i], predictions[i].invdepth.cols, predictions[i].invdepth.rows, images[i].cols, images[i].rows);
+                        exit(1);
+                    }
+                    predictions[i].invdepth = cv::Mat();
+                    missing.push_back(i);
+                    missingIds.push_back(ids[i]);
+                    missingImages.push_back(images[i]);
+                }
+                if (missing.empty())
+                    return;
+
+                if (!fallback_)
+                {
+                    printf("no depth map for image %d in the replay file, and no network loaded!\n", missingIds[0]);
+                    exit(1);
+                }
+                std::vector<DepthPrediction> computed;
+                fallback_->predict(missingIds, missingImages, computed);
+                for (unsigned int i = 0; i < missing.size(); i++)
+                    predictions[missing[i]] = computed[i];
+            }
+
+            std::string name() const override { return "replay"; }
+
+        private:
+            std::shared_ptr<DepthMapStore> store_;
+            std::shared_ptr<DepthPredictor> fallback_;
+    };
+
+
+    /// Deterministic synthetic depth, no network: a ground plane below the horizon (image
+    /// center row) and constant far depth above it. For running / benchmarking the geometric
+    /// pipeline on machines without an inference library.
+    class StubDepthPredictor : public DepthPredictor
+    {
+        public:
+            StubDepthPredictor(float invdepth) : invdepth_(invdepth) {}
+
+            void predict(const std::vector<int>& ids, std::vector<cv::Mat>& images, std::vector<DepthPrediction>& predictions) override
+            {
+                predictions.resize(images.size());
+                for (unsigned int i = 0; i < images.size(); i++)
+                {
+                    const int h = images[i].rows;
+                    const int w = images[i].cols;
+                    cv::Mat invdepth(h, w, CV_32FC1);
+                    for (int y = 0; y < h; y++)
+                    {
+                        // on a plane, inverse depth grows linearly with the distance to the horizon.
+                        float id = invdepth_ * (1 + std::max(0.f, y - 0.5f*h) * 20.f / h);
+                        float* row = invdepth.ptr<float>(y);
+                        for (int x = 0; x < w; x++)
+                            row[x] = id;
+                    }
+                    predictions[i].invdepth = invdepth;
+                    predictions[i].confidence = cv::Mat(h, w, CV_32FC1, cv::Scalar(1.f));
+                }
+            }
+
+            std::string name() const override { return "stub"; }
+
+        private:
+            float invdepth_;
+    };
+
+
+    std::shared_ptr<DepthPredictor> createDepthPredictor(const std::string& backend, const DepthPredictorOptions& options)
+    {
+        if (backend == "torch")
+        {
+#ifdef HAS_TORCH
+            return std::make_shared<MonoDepth>(options.model_file, options.use_gpu, options.num_threads, options.precision, options.scale);
+#else
+            printf("depth backend torch: not compiled in (libtorch not found)! try depthbackend=stub.\n");
+            exit(1);
+#endif
+        }
+        if (backend == "onnx")
+        {
+#ifdef HAS_ONNXRUNTIME
+            return std::make_shared<OnnxDepth>(options.model_file, options.num_threads);
+#else
+            printf("depth backend onnx: not compiled in (onnxruntime not found)! try depthbackend=stub.\n");
+            exit(1);
+#endif
+        }
+        if (backend == "replay")
+        {
+            std::shared_ptr<DepthMapStore> store(DepthMapStore::openReader(options.replay_file, options.width, options.height));
+            if (!store)
+                exit(1);
+            std::shared_ptr<DepthPredictor> fallback;
+            if (options.model_file != "")
+                fallback = createDepthPredictor("torch", options);
+            return std::make_shared<ReplayDepthPredictor>(store, fallback);
+        }
+        if (backend == "stub")
+        {
+            return std::make_shared<StubDepthPredictor>(options.stub_invdepth);
+        }
+
+        printf("unknown depth backend %s (torch, onnx, replay, stub)!\n", backend.c_str());
+        exit(1);
+    }
+
+    void imageToPlanar(const cv::Mat &image, float* __restrict__ r, float* __restrict__ g, float* __restrict__ b)
+    {
+        const float scale = 1.f / 255.f;
+        const int width = image.cols;
+        for (int y = 0; y < image.rows; y++)
+        {
+            if (image.type() == CV_32FC3)
+            {
+                // rgb_image from the reader: RGB, [0, 255]
+                const float* src = image.ptr<float>(y);
+                for (int x = 0; x < width; x++)
+                {
+                    r[x] = src[3*x] * scale;
+                    g[x] = src[3*x+1] * scale;
+                    b[x] = src[3*x+2] * scale;
+                }
+            }
+            else
+            {
+                // straight from cv::imread: BGR, u8
+                const uchar* src = image.ptr<uchar>(y);
+                for (int x = 0; x < width; x++)
+                {
+                    b[x] = src[3*x] * scale;
+                    g[x] = src[3*x+1] * scale;
+                    r[x] = src[3*x+2] * scale;
+                }
+            }
+            r += width;
+            g += width;
+            b += width;
+        }
+    }
+}
+// namespace dso
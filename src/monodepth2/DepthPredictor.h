@@ -0,0 +1,52 @@
+#ifndef DEPTHPREDICTOR_H_
+#define DEPTHPREDICTOR_H_
+
+#include <opencv2/core/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dso{
+
+
+struct DepthPrediction{
+            cv::Mat invdepth;   // CV_32FC1, image size
+            cv::Mat confidence; // CV_32FC1 in [0,1], empty if the backend has none
+    };
+
+
+/// Source of per-frame inverse-depth priors. All backends take the undistorted RGB frame
+/// (FrameHessian::rgb_image) together with the id it was passed into DSO with.
+class DepthPredictor{
+        public:
+            virtual ~DepthPredictor() {}
+
+            /// one prediction per image. images are all of the same size.
+            virtual void predict(const std::vector<int>& ids, std::vector<cv::Mat>& images, std::vector<DepthPrediction>& predictions) = 0;
+
+            /// short name for log output
+            virtual std::string name() const = 0;
+    };
+
+
+struct DepthPredictorOptions{
+            std::string model_file;         // torch / onnx: the network
+            bool use_gpu = true;            // torch
+            int num_threads = 0;            // torch / onnx: intra-op threads, <= 0 for the library default
+            std::string precision = "fp32"; // torch
+            float scale = 1;                // torch: network resolution relative to the image
+            std::string replay_file;        // replay: file written with savedepth=
+            int width = 0, height = 0;      // replay: image size (wG[0] x hG[0]) the file has to match
+            float stub_invdepth = 0.1f;     // stub: inverse depth at the top of the ground plane
+    };
+
+/// RGB float [0,255] (or BGR u8) HWC -> three normalized [0,1] planes, in one pass
+void imageToPlanar(const cv::Mat &image, float* r, float* g, float* b);
+
+/// backend: "torch", "onnx", "replay" or "stub". prints and exits if it's not available in this build.
+/// for "replay", a model_file makes the torch backend the fallback for frames missing from the file.
+std::shared_ptr<DepthPredictor> createDepthPredictor(const std::string& backend, const DepthPredictorOptions& options);
+
+} // namespace dso
+
+#endif
@@ -0,0 +1,90 @@
+#include "OnnxDepth.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <iostream>
+#include <assert.h>
+
+namespace dso
+{
+    OnnxDepth::OnnxDepth(const std::string &model_file, int num_threads) : env_(ORT_LOGGING_LEVEL_WARNING, "dso")
+    {
+        Ort::SessionOptions options;
+        if (num_threads > 0)
+            options.SetIntraOpNumThreads(num_threads);
+        options.SetInterOpNumThreads(1);
+        options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+        session_.reset(new Ort::Session(env_, model_file.c_str(), options));
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        input_name_ = session_->GetInputNameAllocated(0, allocator).get();
+        output_name_ = session_->GetOutputNameAllocated(0, allocator).get();
+
+        std::vector<int64_t> shape = session_->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        assert(shape.size() == 4);
+        model_batch_ = shape[0];
+        model_height_ = shape[2];
+        model_width_ = shape[3];
+        std::cout << "OnnxDepth: loaded " << model_file << ", input " << model_height_ << " x " << model_width_
+                  << ", batch " << (model_batch_ > 0 ? std::to_string(model_batch_) : std::string("dynamic")) << "\n";
+    }
+
+    OnnxDepth::~OnnxDepth() = default;
+
+    void OnnxDepth::predict(const std::vector<int>& ids, std::vector<cv::Mat>& images, std::vector<DepthPrediction>& predictions)
+    {
+        std::lock_guard<std::mutex> lock(inferenceMutex);
+
+        assert(!images.empty());
+        const int batch_size = images.size();
+        const int image_height = images[0].rows;
+        const int image_width = images[0].cols;
+        const int height = model_height_ > 0 ? model_height_ : image_height;
+        const int width = model_width_ > 0 ? model_width_ : image_width;
+
+        // a model exported with a fixed batch size (usually 1) gets the frames in chunks of
+        // that size, the last one zero-padded. a dynamic batch takes all frames in one run.
+        const int chunk = model_batch_ > 0 ? model_batch_ : batch_size;
+
+        const int plane = height*width;
+        input_.resize((size_t)chunk*3*plane);
+        predictions.resize(batch_size);
+
+        Ort::MemoryInfo memory = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        const char* input_names[] = {input_name_.c_str()};
+        const char* output_names[] = {output_name_.c_str()};
+        for (int first = 0; first < batch_size; first += chunk)
+        {
+            const int count = std::min(chunk, batch_size - first);
+            for (int i = 0; i < count; i++)
+            {
+                cv::Mat image = images[first+i];
+                if (image.rows != height || image.cols != width)
+                    cv::resize(images[first+i], image, cv::Size(width, height));
+                float* r = input_.data() + (size_t)3*plane*i;
+                imageToPlanar(image, r, r + plane, r + 2*plane);
+            }
+            if (count < chunk)
+                std::fill(input_.begin() + (size_t)3*plane*count, input_.end(), 0.f);
+
+            std::vector<int64_t> dims = {chunk, 3, height, width};
+            Ort::Value input = Ort::Value::CreateTensor<float>(memory, input_.data(), input_.size(), dims.data(), dims.size());
+            std::vector<Ort::Value> outputs = session_->Run(Ort::RunOptions{nullptr}, input_names, &input, 1, output_names, 1);
+
+            std::vector<int64_t> out_shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+            const int out_height = out_shape[out_shape.size()-2];
+            const int out_width = out_shape[out_shape.size()-1];
+            float* out = outputs[0].GetTensorMutableData<float>();
+
+            for (int i = 0; i < count; i++)
+            {
+                cv::Mat invdepth(out_height, out_width, CV_32FC1, out + (size_t)i*out_height*out_width);
+                if (out_height != image_height || out_width != image_width)
+                    cv::resize(invdepth, predictions[first+i].invdepth, cv::Size(image_width, image_height), 0, 0, cv::INTER_LINEAR);
+                else
+                    predictions[first+i].invdepth = invdepth.clone();
+            }
+        }
+    }
+}
+// namespace dso
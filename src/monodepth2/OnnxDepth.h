@@ -0,0 +1,38 @@
+#ifndef ONNXDEPTH_H_
+#define ONNXDEPTH_H_
+
+#include "DepthPredictor.h"
+
+#include <onnxruntime_cxx_api.h>
+#include <memory>
+#include <mutex>
+
+namespace dso{
+
+
+/// Depth network on the ONNX Runtime CPU execution provider. Expects a [B,3,H,W] float
+/// input in [0,1] and a [B,1,H,W] (or [B,H,W]) inverse-depth output, like the TorchScript
+/// model. Models with a fixed input size get the image resized to it, and the output
+/// resized back.
+class OnnxDepth : public DepthPredictor{
+        public:
+            OnnxDepth(const std::string &model_file, int num_threads = 0);
+            ~OnnxDepth();
+
+            void predict(const std::vector<int>& ids, std::vector<cv::Mat>& images, std::vector<DepthPrediction>& predictions) override;
+            std::string name() const override { return "onnx"; }
+
+        private:
+            Ort::Env env_;
+            std::unique_ptr<Ort::Session> session_;
+            std::string input_name_, output_name_;
+            int64_t model_batch_, model_height_, model_width_; // -1 if dynamic
+
+            // persistent NCHW input. guarded by [inferenceMutex].
+            std::vector<float> input_;
+            std::mutex inferenceMutex;
+    };
+
+} // namespace dso
+
+#endif
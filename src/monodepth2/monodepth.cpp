@@ -6,12 +6,15 @@
 
 #include <torch/serialize/tensor.h>
 #include <torch/serialize.h>
+#include <torch/version.h>
+#include <torch/csrc/jit/passes/freeze_module.h>
 
 // headers for opencv
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/opencv.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <assert.h>
 
@@ -22,8 +25,54 @@ using namespace at; //pytorch c++ api
 namespace dso
 {
     //read torchscript
-    MonoDepth::MonoDepth(const std::string &model_file, int use_gpu) : model_file_(model_file), use_gpu_(use_gpu)
+    MonoDepth::MonoDepth(const std::string &model_file, int use_gpu, int num_threads, const std::string &precision, float scale) : model_file_(model_file), use_gpu_(use_gpu), scale_(scale)
     {
+        // keep the network off the cores the optimizer backend (IndexThreadReduce) works on.
+        if (num_threads > 0)
+        {
+            at::set_num_threads(num_threads);
+            try
+            {
+                // can only be set once per process, before any inter-op work.
+                at::set_num_interop_threads(1);
+            }
+            catch (const c10::Error &e)
+            {
+            }
+        }
+        std::cout << "MonoDepth: using " << at::get_num_threads() << " intra-op threads\n";
+
+        if (precision == "int8")
+        {
+            // quantized kernels only exist on the CPU. fbgemm is the x86 backend.
+            if (use_gpu_)
+            {
+                std::cout << "MonoDepth: int8 models run on the CPU only!\n";
+                use_gpu_ = false;
+            }
+            auto engines = at::globalContext().supportedQEngines();
+            if (std::find(engines.begin(), engines.end(), at::QEngine::FBGEMM) != engines.end())
+                at::globalContext().setQEngine(at::QEngine::FBGEMM);
+        }
+        else if (precision == "fp16")
+        {
+            // e.g. exported with convert_model_to_jit.py --half
+            if (!use_gpu_)
+            {
+                std::cout << "MonoDepth: fp16 needs the GPU, use bf16 on the CPU!\n";
+                exit(1);
+            }
+            input_type_ = torch::kHalf;
+        }
+        else if (precision == "bf16")
+        {
+            input_type_ = torch::kBFloat16;
+        }
+        else if (precision != "fp32")
+        {
+            std::cout << "MonoDepth: unknown precision " << precision << " (fp32, fp16, bf16, int8)!\n";
+            exit(1);
+        }
 
         model = torch::jit::load(model_file_);
         if (use_gpu_ ==true)
@@ -34,6 +83,23 @@ namespace dso
         {
             model.to(at::kCPU);
         }
+        if (input_type_ != torch::kFloat)
+            model.to(input_type_);
+
+        // inference only: inline parameters as constants, fold conv/bn etc.
+        model.eval();
+        try
+        {
+            model = torch::jit::freeze_module(model);
+#if TORCH_VERSION_MAJOR > 1 || TORCH_VERSION_MINOR >= 10
+            if (!use_gpu_)
+                model = torch::jit::optimize_for_inference(model);
+#endif
+        }
+        catch (const c10::Error &e)
+        {
+            std::cout << "MonoDepth: could not freeze " << model_file_ << ", running it as is.\n";
+        }
     }
 
 
@@ -46,50 +112,149 @@ namespace dso
         // to figure out what's going on there.
         // This code may need to be adjusted if, for some reason, images fed into DSO are not the same
         // size as the images the net was trained on.
-        const int height = image.rows;
-        const int width = image.cols;
+        int height, width;
+        networkSize(image.rows, image.cols, height, width);
         invdepth = MonoDepth::inference(image, height, width); // Packnet outputs inverse-depth, not depth
+        if (height != image.rows || width != image.cols)
+            invdepth = guidedUpsample(invdepth, image, 4, 1e-4f);
     }
 
-    cv::Mat MonoDepth::inference(cv::Mat &image,const int &height, const int &width)
+    void MonoDepth::inference(std::vector<cv::Mat> &images, std::vector<cv::Mat> &invdepths)
     {
-        //images_to_tensors
-        assert(!image.empty());
-        cv::Mat input_mat;
-        cv::resize(image, input_mat, cv::Size(width, height));
-
-        // All tests of DSO ran with this, but on closer inspection I'm not sure it's needed and may even be negatively impacting results
-        // Should be tested side by side, both with and without this conversion
-        //[0, 255]
-        input_mat.convertTo(input_mat,CV_32FC1, 1./255.);
-        //[0, 1]
-
-        //!transform a cv::Mat into a tensor   [B, H, W, C]
-        torch::Tensor tensor_image = torch::from_blob(input_mat.data, {1,input_mat.rows, input_mat.cols,3}, torch::kF32);
-        tensor_image = tensor_image.permute({0,3,1,2});//[B, C, H, W]
-
-        if (use_gpu_ == 1)
+        assert(!images.empty());
+        int height, width;
+        networkSize(images[0].rows, images[0].cols, height, width);
+        invdepths = MonoDepth::inference(images, height, width);
+        if (height != images[0].rows || width != images[0].cols)
+            for (unsigned int i = 0; i < images.size(); i++)
+                invdepths[i] = guidedUpsample(invdepths[i], images[i], 4, 1e-4f);
+    }
+
+    void MonoDepth::predict(const std::vector<int>& ids, std::vector<cv::Mat>& images, std::vector<DepthPrediction>& predictions)
+    {
+        std::vector<cv::Mat> invdepths;
+        inference(images, invdepths);
+        predictions.resize(invdepths.size());
+        for (unsigned int i = 0; i < invdepths.size(); i++)
+            predictions[i].invdepth = invdepths[i];
+    }
+
+    void MonoDepth::networkSize(int rows, int cols, int &height, int &width) const
+    {
+        if (scale_ >= 1)
         {
-            tensor_image = tensor_image.to(at::kCUDA);
+            height = rows;
+            width = cols;
+            return;
         }
-        else
+        // the encoder downsamples 5 times
+        height = std::max(32, (int)(rows*scale_/32 + 0.5f)*32);
+        width = std::max(32, (int)(cols*scale_/32 + 0.5f)*32);
+    }
+
+    cv::Mat MonoDepth::guidedUpsample(const cv::Mat &invdepth, const cv::Mat &image, int radius, float eps)
+    {
+        // fast guided filter (He & Sun 2015): fit invdepth ~ a*I + b in each window at low
+        // resolution, then apply the upsampled a, b to the full resolution gray image I.
+        cv::Mat gray, guide;
+        cv::cvtColor(image, gray, image.type() == CV_32FC3 ? cv::COLOR_RGB2GRAY : cv::COLOR_BGR2GRAY);
+        gray.convertTo(guide, CV_32F, 1./255.);
+
+        cv::Mat I;
+        cv::resize(guide, I, invdepth.size(), 0, 0, cv::INTER_AREA);
+        const cv::Mat &p = invdepth;
+        const cv::Size window(2*radius+1, 2*radius+1);
+
+        cv::Mat mean_I, mean_p, corr_II, corr_Ip;
+        cv::boxFilter(I, mean_I, CV_32F, window);
+        cv::boxFilter(p, mean_p, CV_32F, window);
+        cv::boxFilter(I.mul(I), corr_II, CV_32F, window);
+        cv::boxFilter(I.mul(p), corr_Ip, CV_32F, window);
+
+        cv::Mat var_I = corr_II - mean_I.mul(mean_I);
+        cv::Mat cov_Ip = corr_Ip - mean_I.mul(mean_p);
+        cv::Mat a = cov_Ip / (var_I + eps);
+        cv::Mat b = mean_p - a.mul(mean_I);
+
+        cv::Mat mean_a, mean_b;
+        cv::boxFilter(a, mean_a, CV_32F, window);
+        cv::boxFilter(b, mean_b, CV_32F, window);
+        cv::resize(mean_a, mean_a, guide.size(), 0, 0, cv::INTER_LINEAR);
+        cv::resize(mean_b, mean_b, guide.size(), 0, 0, cv::INTER_LINEAR);
+
+        return mean_a.mul(guide) + mean_b;
+    }
+
+    cv::Mat MonoDepth::inference(cv::Mat &image,const int &height, const int &width)
+    {
+        std::vector<cv::Mat> images(1, image);
+        return MonoDepth::inference(images, height, width)[0];
+    }
+
+    void MonoDepth::prepareInput(int batch_size, int height, int width)
+    {
+        if (input_.defined() && input_.size(0) == batch_size && input_.size(2) == height && input_.size(3) == width)
+            return;
+
+        input_ = torch::empty({batch_size, 3, height, width}, torch::kF32);
+        // pinned host memory makes the upload an async DMA instead of a staged copy
+        if (use_gpu_)
+            input_ = input_.pin_memory();
+    }
+
+    std::vector<cv::Mat> MonoDepth::inference(std::vector<cv::Mat> &images, const int &height, const int &width)
+    {
+        std::lock_guard<std::mutex> lock(inferenceMutex);
+
+        //images_to_tensors: [0, 255] HWC -> [0, 1] CHW, written straight into the input tensor
+        const int batch_size = images.size();
+        prepareInput(batch_size, height, width);
+        float* input_data = input_.data_ptr<float>();
+        const int plane = height*width;
+        for (int i = 0; i < batch_size; i++)
         {
-            tensor_image = tensor_image.to(at::kCPU);
+            assert(!images[i].empty());
+            assert(images[i].type() == CV_32FC3 || images[i].type() == CV_8UC3);
+            cv::Mat image = images[i];
+            if (image.rows != height || image.cols != width)
+                cv::resize(images[i], image, cv::Size(width, height));
+
+            float* r = input_data + 3*plane*i;
+            imageToPlanar(image, r, r + plane, r + 2*plane);
         }
+
+        // no autograd bookkeeping
+#if TORCH_VERSION_MAJOR > 1 || TORCH_VERSION_MINOR >= 9
+        c10::InferenceMode inference_mode;
+#else
+        torch::NoGradGuard no_grad;
+#endif
+
+        torch::Tensor tensor_image = use_gpu_ ? input_.to(at::kCUDA, /*non_blocking=*/true) : input_;
+        if (input_type_ != torch::kFloat)
+            tensor_image = tensor_image.to(input_type_);
+
         //[0,1]
         vector<torch::IValue> batch;
         batch.push_back(tensor_image);
         //! get the result
         auto result = model.forward(batch);
-        torch::Tensor disp_tensor = result.toTensor().squeeze();
-        // std::cout << "inference size: " << disp_tensor.sizes() << "\n";
-       
-        disp_tensor = disp_tensor.to(at::kCPU);
+        // [B, 1, H, W] -> [B, H, W]
+        torch::Tensor disp_tensor = result.toTensor();
+        // makeNewTraces() etc. expect a float map, whatever the network computed in.
+        if (disp_tensor.is_quantized())
+            disp_tensor = disp_tensor.dequantize();
+        disp_tensor = disp_tensor.to(torch::kFloat).reshape({batch_size, height, width});
 
-        cv::Mat disp = cv::Mat::eye(height, width, CV_32FC1);
-        std::memcpy((void *) disp.data, disp_tensor.data_ptr(), sizeof(float)*disp_tensor.numel());
+        // the maps are cached by the caller well past the next call, so each one gets its own
+        // Mat; the (device ->) host copy goes straight into it.
+        std::vector<cv::Mat> disps(batch_size);
+        for (int i = 0; i < batch_size; i++)
+        {
+            disps[i].create(height, width, CV_32FC1);
+            torch::from_blob(disps[i].data, {height, width}, torch::kF32).copy_(disp_tensor[i]);
+        }
 
-        
         // This was left behind from the guy we forked this from.
         // Might be worth investigating to confirm whether this is needed or not.
         // All tests were done with this commented out.
@@ -104,7 +269,7 @@ namespace dso
         // disp.convertTo(disp, CV_8UC1);
         // cv::cvtColor(disp, disp, cv::COLOR_GRAY2BGR);
         
-        return disp;
+        return disps;
     }
 
     void MonoDepth::disp2Depth(cv::Mat &dispMap, cv::Mat &depthMap)
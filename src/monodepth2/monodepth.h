@@ -3,8 +3,10 @@
 
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include <mutex>
 #include <torch/torch.h>
 #include <torch/script.h>
+#include "DepthPredictor.h"
 
 using namespace std;
 using namespace cv;
@@ -13,26 +15,48 @@ using namespace at;
 namespace dso{
 
 
-class MonoDepth{
+class MonoDepth : public DepthPredictor{
         public:
-            MonoDepth(const std::string &model_file, int use_gpu);
+            /// num_threads: intra-op threads libtorch may use (<= 0: libtorch default, i.e. all cores)
+            /// precision: "fp32", "fp16" (GPU), "bf16" (CPU) or "int8" (quantized model, CPU)
+            /// scale: run the network at this fraction of the image size, guided-upsample the result
+            MonoDepth(const std::string &model_file, int use_gpu, int num_threads = 0, const std::string &precision = "fp32", float scale = 1);
 
             ~MonoDepth();
 
             /// Infer depth from image (implementation)
             void inference(cv::Mat& image, cv::Mat& depth);
+            /// Infer depth for several images (all of the same size) with a single forward pass
+            void inference(std::vector<cv::Mat>& images, std::vector<cv::Mat>& depths);
             //transform disp into depth
             void disp2Depth(cv::Mat &dispMap, cv::Mat &depthMap);
+
+            void predict(const std::vector<int>& ids, std::vector<cv::Mat>& images, std::vector<DepthPrediction>& predictions) override;
+            std::string name() const override { return "torch"; }
         private:
 
             // inference depth from inputs
             cv::Mat inference(cv::Mat &images,const  int &height, const int &width);
-            
+            std::vector<cv::Mat> inference(std::vector<cv::Mat> &images, const int &height, const int &width);
+
+            // (re)allocates input_ for [batch_size, 3, height, width] if the shape changed
+            void prepareInput(int batch_size, int height, int width);
+            // network input size for an image of the given size (scale_, multiple of 32)
+            void networkSize(int rows, int cols, int &height, int &width) const;
+            // low-res inverse depth -> image size, edges taken from the image (fast guided filter)
+            static cv::Mat guidedUpsample(const cv::Mat &invdepth, const cv::Mat &image, int radius, float eps);
+
             
             std::string model_file_; // the path of the given model
             bool use_gpu_= true; // use GPU or CPU
+            torch::ScalarType input_type_ = torch::kFloat; // the network's input dtype
+            float scale_ = 1; // network resolution relative to the image
             
             torch::jit::script::Module model;
+
+            // persistent NCHW input (pinned when running on the GPU). guarded by [inferenceMutex].
+            torch::Tensor input_;
+            std::mutex inferenceMutex;
     };     
 
 } // namespace monodepth
@@ -0,0 +1,138 @@
+/**
+* This file is part of DSO.
+* 
+* Copyright 2016 Technical University of Munich and Intel.
+* Developed by Jakob Engel <engelj at in dot tum dot de>,
+* for more information see <http://vision.in.tum.de/dso>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* DSO is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* DSO is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with DSO. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+#include "boost/thread.hpp"
+#include <opencv2/core/core.hpp>
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+
+namespace dso
+{
+
+// recycles the large per-frame buffers (irradiance images, color images, pyramid levels):
+// frames are created and released at frame rate, always with the same few sizes.
+// thread-safe; at most maxFreePerSize buffers of each size (and color images) are kept around.
+class BufferPool
+{
+public:
+	static BufferPool& instance()
+	{
+		static BufferPool pool;
+		return pool;
+	}
+
+	~BufferPool()
+	{
+		for(auto &it : freeBuffers)
+			for(void* p : it.second)
+				free(p);
+	}
+
+	// [bytes] of uninitialized memory, 32-byte aligned.
+	void* get(size_t bytes)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			std::vector<void*> &buffers = freeBuffers[bytes];
+			if(buffers.size() > 0)
+			{
+				void* p = buffers.back();
+				buffers.pop_back();
+				return p;
+			}
+		}
+
+		void* p = 0;
+		if(posix_memalign(&p, 32, bytes) != 0)
+		{
+			printf("BufferPool: cannot allocate %zu bytes!\n", bytes);
+			exit(1);
+		}
+		return p;
+	}
+
+	// [bytes] has to be what the buffer was requested with.
+	void release(void* p, size_t bytes)
+	{
+		if(p == 0) return;
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			std::vector<void*> &buffers = freeBuffers[bytes];
+			if(buffers.size() < maxFreePerSize)
+			{
+				buffers.push_back(p);
+				return;
+			}
+		}
+		free(p);
+	}
+
+	template<typename T> inline T* get(size_t n) {return (T*)get(n*sizeof(T));}
+	template<typename T> inline void release(T* p, size_t n) {release((void*)p, n*sizeof(T));}
+
+
+	// uninitialized cv::Mat.
+	cv::Mat getMat(int rows, int cols, int type)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			for(unsigned int i=0;i<freeMats.size();i++)
+			{
+				if(freeMats[i].rows != rows || freeMats[i].cols != cols || freeMats[i].type() != type) continue;
+				cv::Mat m = freeMats[i];
+				freeMats[i] = freeMats.back();
+				freeMats.pop_back();
+				return m;
+			}
+		}
+		return cv::Mat(rows, cols, type);
+	}
+
+	// drops [m]; its memory is recycled if no other cv::Mat refers to it anymore
+	// (e.g. FrameHessian::rgb_image still using the reader's image).
+	void releaseMat(cv::Mat &m)
+	{
+		if(m.u != 0 && m.u->refcount == 1 && m.isContinuous() && m.data == m.datastart)
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			if(freeMats.size() < maxFreePerSize)
+				freeMats.push_back(m);
+		}
+		m.release();
+	}
+
+private:
+	BufferPool() {}
+
+	static const size_t maxFreePerSize = 16;
+
+	boost::mutex mutex;
+	std::unordered_map<size_t, std::vector<void*>> freeBuffers;
+	std::vector<cv::Mat> freeMats;
+};
+
+}
@@ -31,8 +31,11 @@
 #include <fstream>
 #include <dirent.h>
 #include <algorithm>
+#include <map>
 
 #include "util/Undistort.h"
+#include "util/PackedSequence.h"
+#include "util/SequenceManifest.h"
 #include "IOWrapper/ImageRW.h"
 #include <opencv2/opencv.hpp>
 
@@ -101,56 +104,19 @@ struct PrepImageItem
 
 
 
-class ImageFolderReader
+// what all input sources have in common: calibration and undistortion, timestamps and
+// exposures (times.txt next to the source), and background prefetching.
+// a source only has to list its images and decode them.
+class DatasetReader
 {
 public:
-	ImageFolderReader(std::string path, std::string calibFile, std::string gammaFile, std::string vignetteFile)
+	DatasetReader(std::string path, std::string calibFile, std::string gammaFile, std::string vignetteFile)
 	{
 		this->path = path;
 		this->calibfile = calibFile;
 
-#if HAS_ZIPLIB
-		ziparchive=0;
-		databuffer=0;
-#endif
-
-		isZipped = (path.length()>4 && path.substr(path.length()-4) == ".zip");
-
-
-
-
-
-		if(isZipped)
-		{
-#if HAS_ZIPLIB
-			int ziperror=0;
-			ziparchive = zip_open(path.c_str(),  ZIP_RDONLY, &ziperror);
-			if(ziperror!=0)
-			{
-				printf("ERROR %d reading archive %s!\n", ziperror, path.c_str());
-				exit(1);
-			}
-
-			files.clear();
-			int numEntries = zip_get_num_entries(ziparchive, 0);
-			for(int k=0;k<numEntries;k++)
-			{
-				const char* name = zip_get_name(ziparchive, k,  ZIP_FL_ENC_STRICT);
-				std::string nstr = std::string(name);
-				if(nstr == "." || nstr == "..") continue;
-				files.push_back(name);
-			}
-
-			printf("got %d entries and %d files!\n", numEntries, (int)files.size());
-			std::sort(files.begin(), files.end());
-#else
-			printf("ERROR: cannot read .zip archive, as compile without ziplib!\n");
-			exit(1);
-#endif
-		}
-		else
-			getdir (path, files);
-
+		prefetchRunning = false;
+		nextToDecode = nextToConsume = 0;
 
 		undistort = Undistort::getUndistorterForFile(calibFile, gammaFile, vignetteFile);
 
@@ -159,21 +125,21 @@ public:
 		heightOrg = undistort->getOriginalSize()[1];
 		width=undistort->getSize()[0];
 		height=undistort->getSize()[1];
-
-
-		// load timestamps if possible.
-		loadTimestamps();
-		printf("ImageFolderReader: got %d files in %s!\n", (int)files.size(), path.c_str());
-
 	}
-	~ImageFolderReader()
+	// for sources that are already undistorted (no calibration files).
+	DatasetReader(std::string path)
 	{
-#if HAS_ZIPLIB
-		if(ziparchive!=0) zip_close(ziparchive);
-		if(databuffer!=0) delete databuffer;
-#endif
-
-
+		this->path = path;
+		prefetchRunning = false;
+		nextToDecode = nextToConsume = 0;
+		undistort = 0;
+		width = height = widthOrg = heightOrg = 0;
+	}
+	// sources have to call stopPrefetch() in their own destructor: the prefetch
+	// threads use getImageRaw_internal().
+	virtual ~DatasetReader()
+	{
+		stopPrefetch();
 		delete undistort;
 	};
 
@@ -186,7 +152,7 @@ public:
 		return  undistort->getOriginalSize();
 	}
 
-	void getCalibMono(Eigen::Matrix3f &K, int &w, int &h)
+	virtual void getCalibMono(Eigen::Matrix3f &K, int &w, int &h)
 	{
 		K = undistort->getK().cast<float>();
 		w = undistort->getSize()[0];
@@ -215,10 +181,7 @@ public:
 		myfile.close();
 	}
 
-	int getNumImages()
-	{
-		return files.size();
-	}
+	virtual int getNumImages() = 0;
 
 	double getTimestamp(int id)
 	{
@@ -229,121 +192,126 @@ public:
 	}
 
 
-	void prepImage(int id, bool as8U=false)
+	// starts [numThreads] threads that decode and undistort the images in [ids], in that
+	// order, keeping at most [numSlots] of them ready ahead of what getImage() has taken.
+	// getImage() then mostly just hands out finished images; ids not (or no longer)
+	// in the window are decoded directly, as without prefetching.
+	void startPrefetch(const std::vector<int> &ids, int numSlots=8, int numThreads=2)
 	{
-
+		stopPrefetch();
+		if(ids.size()==0 || numSlots < 1 || numThreads < 1) return;
+
+		prefetchOrder = ids;
+		prefetchPos.clear();
+		for(int i=(int)ids.size()-1;i>=0;i--)
+			prefetchPos[ids[i]] = i;
+		prefetchTaken.assign(ids.size(), false);
+		prefetchSlots.assign(numSlots, PrepImageItem(-1));
+		nextToDecode = nextToConsume = 0;
+		prefetchRunning = true;
+
+		for(int i=0;i<numThreads;i++)
+			prefetchThreads.create_thread(boost::bind(&DatasetReader::prefetchLoop, this));
+		printf("DatasetReader: prefetching %d images, %d ahead on %d threads.\n",
+				(int)ids.size(), numSlots, numThreads);
 	}
 
-
-	ImageAndExposure* getImage(int id, bool forceLoadDirectly=false)
+	void stopPrefetch()
 	{
-		return getImage_internal(id, 0);
+		{
+			boost::unique_lock<boost::mutex> lock(prefetchMutex);
+			if(!prefetchRunning) return;
+			prefetchRunning = false;
+			prefetchSignal.notify_all();
+		}
+		prefetchThreads.join_all();
+
+		for(PrepImageItem &item : prefetchSlots)
+			item.release();
+		prefetchSlots.clear();
+		prefetchOrder.clear();
+		prefetchPos.clear();
+		prefetchTaken.clear();
 	}
 
-	std::string getImagePrefix(int id)
+	// the prefetch window follows getImage(), nothing to do here.
+	void prepImage(int id, bool as8U=false)
 	{
-		std::string prefix = fs::path(files[id]).stem();
-		return prefix;
-	}
 
-	inline float* getPhotometricGamma()
-	{
-		if(undistort==0 || undistort->photometricUndist==0) return 0;
-		return undistort->photometricUndist->getG();
 	}
 
 
-	// undistorter. [0] always exists, [1-2] only when MT is enabled.
-	Undistort* undistort;
-private:
-
-
-	cv::Mat getImageRaw_internal(int id, int unused)
+	ImageAndExposure* getImage(int id, bool forceLoadDirectly=false)
 	{
-		if(!isZipped)
+		if(forceLoadDirectly || !prefetchRunning)
+			return getImage_internal(id, 0);
+
+		boost::unique_lock<boost::mutex> lock(prefetchMutex);
+		auto it = prefetchPos.find(id);
+		if(it == prefetchPos.end())
 		{
-			// CHANGE FOR ZIP FILE
-			return IOWrap::readImageRGB_8U(files[id]);
+			lock.unlock();
+			return getImage_internal(id, 0);
 		}
-		else
+
+		int pos = it->second;
+		if(pos < nextToConsume || prefetchTaken[pos] || pos >= nextToDecode)
 		{
-#if HAS_ZIPLIB
-			if(databuffer==0) databuffer = new char[widthOrg*heightOrg*6+10000]; // Why 6?
-			zip_file_t* fle = zip_fopen(ziparchive, files[id].c_str(), 0);
-			long readbytes = zip_fread(fle, databuffer, (long)widthOrg*heightOrg*6+10000); // Why 6?
+			// already handed out, or not started yet: take it out of the queue and
+			// decode it here, instead of waiting for the whole window before it.
+			if(pos >= nextToConsume) markTaken(pos);
+			lock.unlock();
+			return getImage_internal(id, 0);
+		}
 
-			if(readbytes > (long)widthOrg*heightOrg*6) // Why 6?
-			{
-				printf("read %ld/%ld bytes for file %s. increase buffer!!\n", readbytes,(long)widthOrg*heightOrg*6+10000, files[id].c_str()); // Why 6?
-				delete[] databuffer;
-				databuffer = new char[(long)widthOrg*heightOrg*30]; // Why 30?
-				fle = zip_fopen(ziparchive, files[id].c_str(), 0);
-				readbytes = zip_fread(fle, databuffer, (long)widthOrg*heightOrg*30+10000); // Why 30?
-
-				if(readbytes > (long)widthOrg*heightOrg*30) // Why 30?
-				{
-					printf("buffer still to small (read %ld/%ld). abort.\n", readbytes,(long)widthOrg*heightOrg*30+10000); // Why 30?
-					exit(1);
-				}
-			}
+		PrepImageItem &item = prefetchSlots[pos % prefetchSlots.size()];
+		while(!item.isQueud)
+			prefetchSignal.wait(lock);
 
-			return IOWrap::readStreamRGB_8U(databuffer, readbytes);
-#else
-			printf("ERROR: cannot read .zip archive, as compile without ziplib!\n");
-			exit(1);
-#endif
-		}
+		ImageAndExposure* img = item.pt;
+		item.pt = 0;
+		item.isQueud = false;
+		markTaken(pos);
+		return img;
 	}
 
+	// name the outputs for image [id] are saved under.
+	virtual std::string getImagePrefix(int id) = 0;
 
-	ImageAndExposure* getImage_internal(int id, int unused)
+	virtual float* getPhotometricGamma()
 	{
-		cv::Mat rgb_image = getImageRaw_internal(id, 0);
+		if(undistort==0 || undistort->photometricUndist==0) return 0;
+		return undistort->photometricUndist->getG();
+	}
 
-		// Calculate the irradiance (grayscale) from the RGB input
-		cv::Mat gray;
-		cv::cvtColor(rgb_image, gray, cv::COLOR_BGR2GRAY);
-		MinimalImageB* minimg = new MinimalImageB(gray.cols, gray.rows);
-		memcpy(minimg->data, gray.data, gray.rows*gray.cols);
 
-		// Standard undistort on grayscale
-		ImageAndExposure* ret2 = undistort->undistort<unsigned char>(
-				minimg,
+	// undistorter. [0] always exists, [1-2] only when MT is enabled.
+	Undistort* undistort;
+protected:
+	// image [id], decoded to 8-bit BGR. also called from the prefetch threads.
+	virtual cv::Mat getImageRaw_internal(int id, int unused) = 0;
+
+
+	virtual ImageAndExposure* getImage_internal(int id, int unused)
+	{
+		cv::Mat bgr_image = getImageRaw_internal(id, 0);
+
+		// gray irradiance and undistorted RGB in one pass.
+		return undistort->undistortBGR(
+				bgr_image,
 				(exposures.size() == 0 ? 1.0f : exposures[id]),
 				(timestamps.size() == 0 ? 0.0 : timestamps[id]));
+	}
 
-		// Undistort the color channels
-		cv::Mat red, green, blue, output;
-		extractChannel(rgb_image, red, 0);
-		cv::Mat red_undist = undistort->undistortSingleChannel(
-			(&red), (exposures.size() == 0 ? 1.0f : exposures[id]),
-			(timestamps.size() == 0 ? 0.0 : timestamps[id]));
-
-		extractChannel(rgb_image, green, 1);
-		cv::Mat green_undist = undistort->undistortSingleChannel(
-			(&green), (exposures.size() == 0 ? 1.0f : exposures[id]),
-			(timestamps.size() == 0 ? 0.0 : timestamps[id]));
-
-		extractChannel(rgb_image, blue, 2);
-		cv::Mat blue_undist = undistort->undistortSingleChannel(
-			(&blue), (exposures.size() == 0 ? 1.0f : exposures[id]),
-			(timestamps.size() == 0 ? 0.0 : timestamps[id]));
-
-		// Make undistorted RGB image and save it
-		std::vector<cv::Mat> channels;
-		channels.push_back(blue_undist);
-		channels.push_back(green_undist);
-		channels.push_back(red_undist);
-		cv::merge(channels, output);
-		(ret2->rgb_image) = output;
-		delete minimg;
-		return ret2;
+	inline std::string getTimesFile()
+	{
+		return path.substr(0,path.find_last_of('/')) + "/times.txt";
 	}
 
 	inline void loadTimestamps()
 	{
 		std::ifstream tr;
-		std::string timesFile = path.substr(0,path.find_last_of('/')) + "/times.txt";
+		std::string timesFile = getTimesFile();
 		tr.open(timesFile.c_str());
 		while(!tr.eof() && tr.good())
 		{
@@ -407,8 +375,6 @@ private:
 
 
 
-	std::vector<ImageAndExposure*> preloadedImages;
-	std::vector<std::string> files;
 	std::vector<double> timestamps;
 	std::vector<float> exposures;
 
@@ -418,11 +384,489 @@ private:
 	std::string path;
 	std::string calibfile;
 
+private:
+	// caller holds prefetchMutex.
+	void markTaken(int pos)
+	{
+		prefetchTaken[pos] = true;
+		while(nextToConsume < (int)prefetchOrder.size() && prefetchTaken[nextToConsume])
+			nextToConsume++;
+		prefetchSignal.notify_all();
+	}
+
+	void prefetchLoop()
+	{
+		boost::unique_lock<boost::mutex> lock(prefetchMutex);
+		while(true)
+		{
+			while(nextToDecode < (int)prefetchOrder.size() && prefetchTaken[nextToDecode])
+				nextToDecode++;
+
+			// back-pressure: never more than prefetchSlots.size() images ahead.
+			if(!prefetchRunning || nextToDecode >= (int)prefetchOrder.size()) return;
+			if(nextToDecode >= nextToConsume + (int)prefetchSlots.size())
+			{
+				prefetchSignal.wait(lock);
+				continue;
+			}
+
+			int pos = nextToDecode++;
+			int id = prefetchOrder[pos];
+			lock.unlock();
+			ImageAndExposure* img = getImage_internal(id, 0);
+			lock.lock();
+
+			PrepImageItem &item = prefetchSlots[pos % prefetchSlots.size()];
+			item.id = id;
+			item.pt = img;
+			item.isQueud = true;
+			prefetchSignal.notify_all();
+		}
+	}
+
+	// prefetching: image prefetchOrder[pos] goes to prefetchSlots[pos % size].
+	std::vector<int> prefetchOrder;
+	std::map<int,int> prefetchPos;
+	std::vector<bool> prefetchTaken;
+	std::vector<PrepImageItem> prefetchSlots;
+	int nextToDecode, nextToConsume;
+	bool prefetchRunning;
+	boost::mutex prefetchMutex;
+	boost::condition_variable prefetchSignal;
+	boost::thread_group prefetchThreads;
+};
+
+
+
+// a directory of images, or a .zip archive of them.
+class ImageFolderReader : public DatasetReader
+{
+public:
+	// [useManifest]: read the file list and timestamps from <path>.manifest, and
+	// (re)generate it if it is missing or out of date.
+	ImageFolderReader(std::string path, std::string calibFile, std::string gammaFile, std::string vignetteFile, bool useManifest=true)
+		: DatasetReader(path, calibFile, gammaFile, vignetteFile)
+	{
+		isZipped = (path.length()>4 && path.substr(path.length()-4) == ".zip");
+
+		manifest = 0;
+		std::string manifestFile = (path.back() == '/' ? path.substr(0, path.length()-1) : path) + ".manifest";
+		// zip entries are already relative, getdir() prefixes the folder as given.
+		std::string manifestBase = isZipped ? "" : (path.back() == '/' ? path : path + "/");
+		if(useManifest)
+			manifest = SequenceManifest::open(manifestFile, path, getTimesFile(), manifestBase);
+
+		if(manifest != 0)
+		{
+			manifest->getTimestamps(timestamps, exposures);
+			printf("ImageFolderReader: got %d files and %d timestamps from %s!\n",
+					getNumImages(), (int)timestamps.size(), manifestFile.c_str());
+			return;
+		}
+
+		if(isZipped)
+		{
+#if HAS_ZIPLIB
+			zip_t* ziparchive = acquireZip();
+
+			files.clear();
+			int numEntries = zip_get_num_entries(ziparchive, 0);
+			for(int k=0;k<numEntries;k++)
+			{
+				const char* name = zip_get_name(ziparchive, k,  ZIP_FL_ENC_STRICT);
+				std::string nstr = std::string(name);
+				if(nstr == "." || nstr == "..") continue;
+				files.push_back(name);
+			}
+
+			printf("got %d entries and %d files!\n", numEntries, (int)files.size());
+			std::sort(files.begin(), files.end());
+			releaseZip(ziparchive);
+#else
+			printf("ERROR: cannot read .zip archive, as compile without ziplib!\n");
+			exit(1);
+#endif
+		}
+		else
+			getdir (path, files);
+
+
+		// load timestamps if possible.
+		loadTimestamps();
+		printf("ImageFolderReader: got %d files in %s!\n", (int)files.size(), path.c_str());
+
+		if(useManifest && files.size() > 0)
+			SequenceManifest::write(manifestFile, path, getTimesFile(), manifestBase, files, timestamps, exposures);
+	}
+	~ImageFolderReader()
+	{
+		stopPrefetch();
+		if(manifest != 0) delete manifest;
+
+#if HAS_ZIPLIB
+		for(zip_t* z : zipHandles)
+			zip_close(z);
+#endif
+	};
+
+	int getNumImages()
+	{
+		return manifest != 0 ? manifest->getNumImages() : files.size();
+	}
+
+	std::string getImagePrefix(int id)
+	{
+		if(manifest != 0) return manifest->getPrefix(id);
+		std::string prefix = fs::path(files[id]).stem();
+		return prefix;
+	}
+
+private:
+	inline std::string getFile(int id)
+	{
+		return manifest != 0 ? manifest->getFile(id) : files[id];
+	}
+
+	cv::Mat getImageRaw_internal(int id, int unused)
+	{
+		std::string file = getFile(id);
+		int reduction = decodeReduction(file);
+		if(!isZipped)
+		{
+			// CHANGE FOR ZIP FILE
+			cv::Mat img = IOWrap::readImageRGB_8U(file, reduction);
+			if(reduction > 1 && !isReducedSize(img))
+				img = IOWrap::readImageRGB_8U(file);
+			return img;
+		}
+		else
+		{
+#if HAS_ZIPLIB
+			zip_t* archive = acquireZip();
+			zip_stat_t st;
+			zip_stat_init(&st);
+			if(zip_stat(archive, file.c_str(), 0, &st) != 0 || !(st.valid & ZIP_STAT_SIZE))
+			{
+				printf("cannot stat %s in archive %s!\n", file.c_str(), path.c_str());
+				exit(1);
+			}
+
+			// exactly the uncompressed size; each decoding thread reuses its buffer.
+			static thread_local std::vector<char> databuffer;
+			databuffer.resize(st.size);
+			zip_file_t* fle = zip_fopen(archive, file.c_str(), 0);
+			long readbytes = (fle == 0) ? -1 : zip_fread(fle, databuffer.data(), st.size);
+			if(fle != 0) zip_fclose(fle);
+			releaseZip(archive);
+
+			if(readbytes != (long)st.size)
+			{
+				printf("read %ld/%ld bytes for file %s. abort.\n", readbytes, (long)st.size, file.c_str());
+				exit(1);
+			}
+
+			cv::Mat img = IOWrap::readStreamRGB_8U(databuffer.data(), readbytes, reduction);
+			if(reduction > 1 && !isReducedSize(img))
+				img = IOWrap::readStreamRGB_8U(databuffer.data(), readbytes);
+			return img;
+#else
+			printf("ERROR: cannot read .zip archive, as compile without ziplib!\n");
+			exit(1);
+#endif
+		}
+	}
+
+
+	// when running at reduced resolution, JPEGs are decoded at a fraction of their
+	// resolution right away (DCT scaling); Undistort has the remap for that size.
+	int decodeReduction(const std::string &file)
+	{
+		if(undistort->getReducedFactor() == 1) return 1;
+		std::string ext = fs::path(file).extension();
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		return (ext == ".jpg" || ext == ".jpeg") ? undistort->getReducedFactor() : 1;
+	}
+
+	// decoders that don't scale like libjpeg: fall back to the full image.
+	bool isReducedSize(const cv::Mat &img)
+	{
+		if(img.cols == undistort->getReducedSize()[0] && img.rows == undistort->getReducedSize()[1]) return true;
+		printf("reduced decode gave %d x %d instead of %d x %d, reading full resolution.\n",
+				img.cols, img.rows, undistort->getReducedSize()[0], undistort->getReducedSize()[1]);
+		return false;
+	}
+
+
+	std::vector<ImageAndExposure*> preloadedImages;
+	// the file list: from the manifest if there is one, else files.
+	SequenceManifest* manifest;
+	std::vector<std::string> files;
+
 	bool isZipped;
 
 #if HAS_ZIPLIB
-	zip_t* ziparchive;
-	char* databuffer;
+	// libzip handles can't be shared between threads: every reading thread takes
+	// one of its own out of zipHandles (opening a new one if there is none).
+	zip_t* acquireZip()
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(zipMutex);
+			if(zipHandles.size() > 0)
+			{
+				zip_t* z = zipHandles.back();
+				zipHandles.pop_back();
+				return z;
+			}
+		}
+
+		int ziperror=0;
+		zip_t* z = zip_open(path.c_str(),  ZIP_RDONLY, &ziperror);
+		if(ziperror!=0)
+		{
+			printf("ERROR %d reading archive %s!\n", ziperror, path.c_str());
+			exit(1);
+		}
+		return z;
+	}
+
+	void releaseZip(zip_t* z)
+	{
+		boost::unique_lock<boost::mutex> lock(zipMutex);
+		zipHandles.push_back(z);
+	}
+
+	std::vector<zip_t*> zipHandles;
+	boost::mutex zipMutex;
 #endif
 };
 
+
+
+// frames of a video file (anything cv::VideoCapture decodes, e.g. the mp4 / h.264 of a
+// dashcam), streamed without extracting them first. image i is frame i*decimation.
+// images carry the decoder's timestamp of their frame (variable frame rate, dropped
+// frames), unless there is a times.txt next to the video with one line per image.
+// getTimestamp() only has frame / fps until then, which is good enough to schedule playback.
+// the frame count in the header can be off: images past the end of the stream are 0.
+class VideoFileReader : public DatasetReader
+{
+public:
+	VideoFileReader(std::string path, std::string calibFile, std::string gammaFile, std::string vignetteFile, int decimation=1)
+		: DatasetReader(path, calibFile, gammaFile, vignetteFile)
+	{
+		this->decimation = std::max(1, decimation);
+		nextFrame = 0;
+
+		if(!capture.open(path))
+		{
+			printf("ERROR: cannot open video %s!\n", path.c_str());
+			exit(1);
+		}
+		int numFrames = (int)capture.get(cv::CAP_PROP_FRAME_COUNT);
+		fps = capture.get(cv::CAP_PROP_FPS);
+		if(fps <= 0) fps = 30;
+		numImages = (numFrames + this->decimation - 1) / this->decimation;
+
+		loadTimestamps();
+		timesFromFile = timestamps.size() > 0;
+		if(!timesFromFile)
+			for(int i=0;i<numImages;i++)
+				timestamps.push_back(i * this->decimation / fps);
+
+		printf("VideoFileReader: got %d frames (%.2f fps) in %s, using every %d-th!\n",
+				numFrames, fps, path.c_str(), this->decimation);
+	}
+	~VideoFileReader()
+	{
+		stopPrefetch();
+	};
+
+	int getNumImages()
+	{
+		return numImages;
+	}
+
+	std::string getImagePrefix(int id)
+	{
+		char buf[32];
+		snprintf(buf, 32, "_%06d", id * decimation);
+		return std::string(fs::path(path).stem()) + buf;
+	}
+
+private:
+	cv::Mat getImageRaw_internal(int id, int unused)
+	{
+		double timestamp;
+		return decodeFrame(id, timestamp);
+	}
+
+	ImageAndExposure* getImage_internal(int id, int unused)
+	{
+		double timestamp;
+		cv::Mat bgr_image = decodeFrame(id, timestamp);
+		if(bgr_image.empty()) return 0;
+
+		return undistort->undistortBGR(
+				bgr_image,
+				(exposures.size() == 0 ? 1.0f : exposures[id]),
+				(timesFromFile ? timestamps[id] : timestamp));
+	}
+
+	// frame id*decimation and its timestamp in seconds. empty past the end of the stream.
+	cv::Mat decodeFrame(int id, double &timestamp)
+	{
+		boost::unique_lock<boost::mutex> lock(captureMutex);
+
+		// decoded earlier on the way to another frame (prefetch threads ask out of order).
+		auto it = decoded.find(id);
+		if(it != decoded.end())
+		{
+			cv::Mat img = it->second.image;
+			timestamp = it->second.timestamp;
+			decoded.erase(it);
+			return img;
+		}
+		if(id >= numImages) return cv::Mat();
+
+		int frame = id * decimation;
+		if(frame < nextFrame || frame > nextFrame + maxFramesToSkip)
+		{
+			// only for start= and reverse=1, otherwise frames are read in order.
+			capture.set(cv::CAP_PROP_POS_FRAMES, frame);
+			nextFrame = frame;
+		}
+
+		while(true)
+		{
+			if(!capture.grab())
+			{
+				// the frame count in the header can be slightly off. the sequence ends here.
+				printf("VideoFileReader: %s ends at frame %d, stopping there!\n", path.c_str(), nextFrame);
+				numImages = std::min(numImages, (nextFrame + decimation - 1) / decimation);
+				return cv::Mat();
+			}
+
+			int current = nextFrame++;
+			if(current % decimation != 0) continue;
+
+			// position of the frame just grabbed. some backends have none, then frame / fps.
+			double msec = capture.get(cv::CAP_PROP_POS_MSEC);
+			double stamp = (msec > 0 || current == 0) ? msec / 1000 : current / fps;
+
+			cv::Mat img;
+			capture.retrieve(img);
+			if(current == frame)
+			{
+				timestamp = stamp;
+				return img;
+			}
+
+			DecodedFrame &d = decoded[current / decimation];
+			d.image = img;
+			d.timestamp = stamp;
+			if(decoded.size() > maxDecoded) decoded.erase(decoded.begin());
+		}
+	}
+
+	cv::VideoCapture capture;
+	boost::mutex captureMutex;
+	struct DecodedFrame
+	{
+		cv::Mat image;
+		double timestamp;
+	};
+	std::map<int, DecodedFrame> decoded;
+	int nextFrame;
+	int numImages;
+	int decimation;
+	double fps;
+	bool timesFromFile;
+
+	static const int maxFramesToSkip = 100;
+	static const size_t maxDecoded = 16;
+};
+
+
+// images packed by dso_pack (see PackedSequence): already undistorted, mapped into memory,
+// getImage() only wraps the mapping. calibration, timestamps and exposures come from the file.
+class PackedSequenceReader : public DatasetReader
+{
+public:
+	PackedSequenceReader(std::string path) : DatasetReader(path)
+	{
+		pack = PackedSequence::openReader(path);
+		if(pack == 0) exit(1);
+
+		const PackedSequenceHeader &header = pack->getHeader();
+		width = widthOrg = header.width;
+		height = heightOrg = header.height;
+		for(int i=0;i<pack->getNumImages();i++)
+		{
+			timestamps.push_back(pack->getInfo(i).timestamp);
+			exposures.push_back(pack->getInfo(i).exposure);
+		}
+	}
+	~PackedSequenceReader()
+	{
+		stopPrefetch();
+		delete pack;
+	};
+
+	void getCalibMono(Eigen::Matrix3f &K, int &w, int &h)
+	{
+		const PackedSequenceHeader &header = pack->getHeader();
+		for(int r=0;r<3;r++)
+			for(int c=0;c<3;c++)
+				K(r,c) = header.K[3*r+c];
+		w = header.width;
+		h = header.height;
+	}
+
+	float* getPhotometricGamma()
+	{
+		const PackedSequenceHeader &header = pack->getHeader();
+		return header.hasGamma ? (float*)header.G : 0;
+	}
+
+	int getNumImages()
+	{
+		return pack->getNumImages();
+	}
+
+	std::string getImagePrefix(int id)
+	{
+		return pack->getPrefix(id);
+	}
+
+private:
+	ImageAndExposure* getImage_internal(int id, int unused)
+	{
+		return pack->getImage(id);
+	}
+
+	// not used, the images are already decoded.
+	cv::Mat getImageRaw_internal(int id, int unused)
+	{
+		return cv::Mat();
+	}
+
+	PackedSequence* pack;
+};
+
+
+inline bool isVideoFile(std::string path)
+{
+	std::string ext = fs::path(path).extension();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == ".mp4" || ext == ".mov" || ext == ".avi" || ext == ".mkv" || ext == ".h264" || ext == ".ts";
+}
+
+// image folder, .zip, video or packed file (.dsopack), depending on [path].
+inline DatasetReader* createDatasetReader(std::string path, std::string calibFile, std::string gammaFile, std::string vignetteFile, int videoDecimation=1, bool useManifest=true)
+{
+	if(fs::path(path).extension() == ".dsopack")
+		return new PackedSequenceReader(path);
+	if(isVideoFile(path))
+		return new VideoFileReader(path, calibFile, gammaFile, vignetteFile, videoDecimation);
+	return new ImageFolderReader(path, calibFile, gammaFile, vignetteFile, useManifest);
+}
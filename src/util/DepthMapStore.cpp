@@ -0,0 +1,176 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/DepthMapStore.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dso {
+
+static const char depthMapMagic[8] = {'D', 'S', 'O', 'D', 'E', 'P', 'T', 'H'};
+static const int32_t depthMapVersion = 1;
+
+DepthMapStore::DepthMapStore() {
+  width = height = 0;
+  outFile = 0;
+  mapped = 0;
+  mappedSize = 0;
+}
+
+DepthMapStore::~DepthMapStore() {
+  if (outFile != 0) {
+    fclose(outFile);
+    printf("DepthMapStore: wrote %d depth maps to %s\n", (int)written.size(),
+           filename.c_str());
+  }
+  if (mapped != 0)
+    munmap(mapped, mappedSize);
+}
+
+DepthMapStore *DepthMapStore::createWriter(const std::string &file, int width,
+                                           int height) {
+  FILE *f = fopen(file.c_str(), "wb");
+  if (f == 0) {
+    printf("DepthMapStore: cannot open %s for writing!\n", file.c_str());
+    return 0;
+  }
+
+  DepthMapFileHeader header;
+  memcpy(header.magic, depthMapMagic, 8);
+  header.version = depthMapVersion;
+  header.width = width;
+  header.height = height;
+  header.reserved = 0;
+  fwrite(&header, sizeof(DepthMapFileHeader), 1, f);
+
+  DepthMapStore *store = new DepthMapStore();
+  store->filename = file;
+  store->outFile = f;
+  store->width = width;
+  store->height = height;
+  return store;
+}
+
+DepthMapStore *DepthMapStore::openReader(const std::string &file, int width,
+                                         int height) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("DepthMapStore: cannot open %s!\n", file.c_str());
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DepthMapFileHeader)) {
+    printf("DepthMapStore: %s is too small to be a depth map file!\n",
+           file.c_str());
+    close(fd);
+    return 0;
+  }
+
+  // private + writable: consumers may modify the returned maps in place,
+  // which only touches their own copy of the page.
+  size_t size = st.st_size;
+  void *mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    printf("DepthMapStore: mmap of %s failed!\n", file.c_str());
+    return 0;
+  }
+
+  DepthMapFileHeader header;
+  memcpy(&header, mem, sizeof(DepthMapFileHeader));
+  if (memcmp(header.magic, depthMapMagic, 8) != 0 ||
+      header.version != depthMapVersion || header.width <= 0 ||
+      header.height <= 0) {
+    printf("DepthMapStore: %s is not a depth map file (version %d)!\n",
+           file.c_str(), depthMapVersion);
+    munmap(mem, size);
+    return 0;
+  }
+  if (header.width != width || header.height != height) {
+    printf("DepthMapStore: %s holds %d x %d depth maps, but the images are %d "
+           "x %d!\n",
+           file.c_str(), header.width, header.height, width, height);
+    munmap(mem, size);
+    return 0;
+  }
+
+  DepthMapStore *store = new DepthMapStore();
+  store->filename = file;
+  store->mapped = (char *)mem;
+  store->mappedSize = size;
+  store->width = header.width;
+  store->height = header.height;
+
+  // a truncated last record (crashed writer) is ignored.
+  size_t recordSize =
+      2 * sizeof(int32_t) + sizeof(float) * header.width * header.height;
+  size_t numRecords = (size - sizeof(DepthMapFileHeader)) / recordSize;
+  for (size_t i = 0; i < numRecords; i++) {
+    char *record = store->mapped + sizeof(DepthMapFileHeader) + i * recordSize;
+    int32_t id;
+    memcpy(&id, record, sizeof(int32_t));
+    store->index[id] = (float *)(record + 2 * sizeof(int32_t));
+  }
+
+  printf("DepthMapStore: replaying %d depth maps (%d x %d) from %s\n",
+         store->size(), store->width, store->height, file.c_str());
+  return store;
+}
+
+void DepthMapStore::write(int id, const cv::Mat &invdepth) {
+  if (outFile == 0 || invdepth.empty())
+    return;
+  assert(invdepth.type() == CV_32FC1);
+
+  boost::unique_lock<boost::mutex> lock(writeMutex);
+  if (written.count(id))
+    return;
+
+  if (invdepth.cols != width || invdepth.rows != height) {
+    printf("DepthMapStore: depth map %d has size %d x %d, expected %d x %d. "
+           "not saved!\n",
+           id, invdepth.cols, invdepth.rows, width, height);
+    return;
+  }
+
+  int32_t recordHead[2] = {id, 0};
+  fwrite(recordHead, sizeof(int32_t), 2, outFile);
+  for (int y = 0; y < height; y++)
+    fwrite(invdepth.ptr<float>(y), sizeof(float), width, outFile);
+  written.insert(id);
+}
+
+cv::Mat DepthMapStore::read(int id) const {
+  auto it = index.find(id);
+  if (it == index.end())
+    return cv::Mat();
+  return cv::Mat(height, width, CV_32FC1, it->second);
+}
+
+} // namespace dso
@@ -0,0 +1,92 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+#include <set>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+
+namespace dso {
+
+struct DepthMapFileHeader {
+  char magic[8]; // "DSODEPTH"
+  int32_t version;
+  int32_t width;
+  int32_t height;
+  int32_t reserved;
+};
+
+// inverse-depth maps of one sequence in a single file, keyed by the id the
+// image was passed into DSO with (FrameShell::incoming_id).
+// written while the network runs, replayed via mmap without the network.
+//
+// layout: DepthMapFileHeader, followed by fixed-size records
+//   {int32 id, int32 reserved, float invdepth[width*height]}.
+class DepthMapStore {
+public:
+  // creates (truncates) [file] for writing maps of [width] x [height], the
+  // run's image size (wG[0] x hG[0]).
+  static DepthMapStore *createWriter(const std::string &file, int width,
+                                     int height);
+  // maps an existing [file] read-only. returns 0 if it can't be used, or if
+  // its maps are not [width] x [height].
+  static DepthMapStore *openReader(const std::string &file, int width,
+                                   int height);
+  ~DepthMapStore();
+
+  inline bool isReader() const { return mapped != 0; }
+
+  // appends one map (CV_32FC1). ids already in the file are skipped.
+  // thread-safe.
+  void write(int id, const cv::Mat &invdepth);
+
+  // returns the map stored for [id] (no copy, copy-on-write view into the
+  // mapping), or an empty Mat if there is none.
+  cv::Mat read(int id) const;
+  inline bool contains(int id) const { return index.count(id) > 0; }
+  inline int size() const { return (int)index.size(); }
+
+  int width, height;
+
+private:
+  DepthMapStore();
+
+  std::string filename;
+
+  // writer
+  FILE *outFile;
+  std::set<int> written;
+  boost::mutex writeMutex;
+
+  // reader
+  char *mapped;
+  size_t mappedSize;
+  std::unordered_map<int, float *> index;
+};
+
+} // namespace dso
@@ -26,6 +26,7 @@
 #include <cstring>
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include "util/BufferPool.h"
 
 
 namespace dso
@@ -41,14 +42,24 @@ public:
 	int w,h;				// width and height;
 	double timestamp;
 	float exposure_time;	// exposure time in ms.
+	bool ownsImage;			// false: [image] is someone else's memory (e.g. a mapped file).
 	inline ImageAndExposure(int w_, int h_, double timestamp_=0) : w(w_), h(h_), timestamp(timestamp_)
 	{
-		image = new float[w*h];
+		image = BufferPool::instance().get<float>(w*h);
 		exposure_time=1;
+		ownsImage=true;
+	}
+	// wraps [image_] without copying; it has to outlive this object.
+	inline ImageAndExposure(int w_, int h_, float* image_, double timestamp_=0) : w(w_), h(h_), timestamp(timestamp_)
+	{
+		image = image_;
+		exposure_time=1;
+		ownsImage=false;
 	}
 	inline ~ImageAndExposure()
 	{
-		delete[] image;
+		if(ownsImage) BufferPool::instance().release(image, w*h);
+		BufferPool::instance().releaseMat(rgb_image);
 	}
 
 	inline void copyMetaTo(ImageAndExposure &other)
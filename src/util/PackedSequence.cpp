@@ -0,0 +1,224 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/PackedSequence.h"
+#include "util/settings.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dso {
+
+static const char packedMagic[8] = {'D', 'S', 'O', 'P', 'A', 'C', 'K', 0};
+// 2: prefixes of any length in a string table (1 cut them at 47 chars).
+static const int32_t packedVersion = 2;
+
+PackedSequence::PackedSequence() {
+  memset(&header, 0, sizeof(PackedSequenceHeader));
+  outFile = 0;
+  strings = 0;
+  mapped = 0;
+  mappedSize = 0;
+}
+
+PackedSequence::~PackedSequence() {
+  if (outFile != 0) {
+    // image table and prefixes at the end, then the final header.
+    header.numImages = (int)infos.size();
+    header.infoOffset = ftello(outFile);
+    header.stringsOffset =
+        header.infoOffset + infos.size() * sizeof(PackedImageInfo);
+    header.stringsSize = prefixes.size();
+    if (infos.size() > 0)
+      fwrite(infos.data(), sizeof(PackedImageInfo), infos.size(), outFile);
+    fwrite(prefixes.data(), 1, prefixes.size(), outFile);
+    fseeko(outFile, 0, SEEK_SET);
+    fwrite(&header, sizeof(PackedSequenceHeader), 1, outFile);
+    fclose(outFile);
+    printf("PackedSequence: wrote %d images to %s\n", header.numImages,
+           filename.c_str());
+  }
+  if (mapped != 0)
+    munmap(mapped, mappedSize);
+}
+
+size_t PackedSequence::imageBytes() const {
+  return sizeof(float) * header.width * header.height *
+         (header.hasRGB ? 4 : 1);
+}
+
+PackedSequence *PackedSequence::createWriter(const std::string &file,
+                                             int width, int height,
+                                             bool withRGB,
+                                             const Eigen::Matrix3f &K,
+                                             const float *G) {
+  FILE *f = fopen(file.c_str(), "wb");
+  if (f == 0) {
+    printf("PackedSequence: cannot open %s for writing!\n", file.c_str());
+    return 0;
+  }
+
+  PackedSequence *pack = new PackedSequence();
+  pack->filename = file;
+  pack->outFile = f;
+
+  PackedSequenceHeader &header = pack->header;
+  memcpy(header.magic, packedMagic, 8);
+  header.version = packedVersion;
+  header.width = width;
+  header.height = height;
+  header.hasRGB = withRGB;
+  header.photometricCalibration = setting_photometricCalibration;
+  for (int r = 0; r < 3; r++)
+    for (int c = 0; c < 3; c++)
+      header.K[3 * r + c] = K(r, c);
+  header.hasGamma = G != 0;
+  if (G != 0)
+    memcpy(header.G, G, sizeof(float) * 256);
+
+  // placeholder, rewritten when done.
+  fwrite(&header, sizeof(PackedSequenceHeader), 1, f);
+  return pack;
+}
+
+PackedSequence *PackedSequence::openReader(const std::string &file) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("PackedSequence: cannot open %s!\n", file.c_str());
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PackedSequenceHeader)) {
+    printf("PackedSequence: %s is too small to be a packed sequence!\n",
+           file.c_str());
+    close(fd);
+    return 0;
+  }
+
+  // private + writable: consumers may modify the images in place, which only
+  // touches their own copy of the page.
+  size_t size = st.st_size;
+  void *mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    printf("PackedSequence: mmap of %s failed!\n", file.c_str());
+    return 0;
+  }
+
+  PackedSequence *pack = new PackedSequence();
+  pack->filename = file;
+  pack->mapped = (char *)mem;
+  pack->mappedSize = size;
+  memcpy(&pack->header, mem, sizeof(PackedSequenceHeader));
+
+  const PackedSequenceHeader &header = pack->header;
+  if (memcmp(header.magic, packedMagic, 8) != 0 ||
+      header.version != packedVersion || header.width <= 0 ||
+      header.height <= 0 || header.numImages < 0 ||
+      header.infoOffset < (int64_t)sizeof(PackedSequenceHeader) ||
+      header.infoOffset + header.numImages * sizeof(PackedImageInfo) > size ||
+      header.stringsOffset < header.infoOffset || header.stringsSize < 0 ||
+      (size_t)(header.stringsOffset + header.stringsSize) > size ||
+      sizeof(PackedSequenceHeader) + header.numImages * pack->imageBytes() >
+          (size_t)header.infoOffset) {
+    printf("PackedSequence: %s is not a complete packed sequence (version "
+           "%d)!\n",
+           file.c_str(), packedVersion);
+    delete pack;
+    return 0;
+  }
+
+  pack->infos.resize(header.numImages);
+  memcpy(pack->infos.data(), pack->mapped + header.infoOffset,
+         header.numImages * sizeof(PackedImageInfo));
+  pack->strings = pack->mapped + header.stringsOffset;
+  for (const PackedImageInfo &info : pack->infos)
+    if (info.prefixOffset < 0 || info.prefixLength < 0 ||
+        info.prefixOffset + info.prefixLength > header.stringsSize) {
+      printf("PackedSequence: %s has a broken image table!\n", file.c_str());
+      delete pack;
+      return 0;
+    }
+
+  if (header.photometricCalibration != setting_photometricCalibration)
+    printf("PackedSequence: WARNING: %s was packed with photometric "
+           "calibration %d, running with %d!\n",
+           file.c_str(), header.photometricCalibration,
+           setting_photometricCalibration);
+
+  printf("PackedSequence: %d images (%d x %d%s) in %s\n", header.numImages,
+         header.width, header.height, header.hasRGB ? ", with RGB" : "",
+         file.c_str());
+  return pack;
+}
+
+void PackedSequence::write(const ImageAndExposure *image,
+                           const std::string &prefix) {
+  if (outFile == 0)
+    return;
+  if (image->w != header.width || image->h != header.height ||
+      (header.hasRGB && (image->rgb_image.type() != CV_32FC3 ||
+                         image->rgb_image.cols != header.width ||
+                         image->rgb_image.rows != header.height))) {
+    printf("PackedSequence: image %d has the wrong size / no RGB!\n",
+           (int)infos.size());
+    exit(1);
+  }
+
+  fwrite(image->image, sizeof(float), header.width * header.height, outFile);
+  if (header.hasRGB)
+    for (int y = 0; y < header.height; y++)
+      fwrite(image->rgb_image.ptr<float>(y), sizeof(float), 3 * header.width,
+             outFile);
+
+  PackedImageInfo info;
+  memset(&info, 0, sizeof(PackedImageInfo));
+  info.timestamp = image->timestamp;
+  info.exposure = image->exposure_time;
+  info.prefixOffset = prefixes.size();
+  info.prefixLength = (int)prefix.size();
+  prefixes += prefix;
+  infos.push_back(info);
+}
+
+std::string PackedSequence::getPrefix(int id) const {
+  return std::string(strings + infos[id].prefixOffset, infos[id].prefixLength);
+}
+
+ImageAndExposure *PackedSequence::getImage(int id) const {
+  float *data =
+      (float *)(mapped + sizeof(PackedSequenceHeader) + id * imageBytes());
+  ImageAndExposure *image = new ImageAndExposure(
+      header.width, header.height, data, infos[id].timestamp);
+  image->exposure_time = infos[id].exposure;
+  if (header.hasRGB)
+    image->rgb_image = cv::Mat(header.height, header.width, CV_32FC3,
+                               data + header.width * header.height);
+  return image;
+}
+
+} // namespace dso
@@ -0,0 +1,106 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "util/ImageAndExposure.h"
+#include <Eigen/Core>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace dso {
+
+struct PackedSequenceHeader {
+  char magic[8]; // "DSOPACK\0"
+  int32_t version;
+  int32_t width, height; // of the undistorted images
+  int32_t numImages;
+  int32_t hasRGB;
+  int32_t hasGamma;
+  int32_t photometricCalibration; // setting_photometricCalibration when packed
+  int32_t reserved;
+  int64_t infoOffset; // file offset of the PackedImageInfo table
+  int64_t stringsOffset, stringsSize; // the prefixes, after the table
+  float K[9];         // undistorted camera matrix, row-major
+  float G[256];       // photometric response (getPhotometricGamma), if hasGamma
+};
+
+struct PackedImageInfo {
+  double timestamp;
+  float exposure; // ImageAndExposure::exposure_time
+  int32_t prefixLength;
+  int64_t prefixOffset; // DatasetReader::getImagePrefix, into the strings, not
+                        // 0-terminated
+};
+
+// undistorted frames of one sequence in a single file, so repeated runs skip
+// decoding and undistortion. written by dso_pack, read via mmap.
+//
+// layout: PackedSequenceHeader, then per image the irradiance image
+//   float[width*height], followed by the RGB image float[3*width*height] if
+//   hasRGB, then the PackedImageInfo table at infoOffset and the prefixes
+//   at stringsOffset.
+class PackedSequence {
+public:
+  // creates (truncates) [file]. [G] may be 0.
+  static PackedSequence *createWriter(const std::string &file, int width,
+                                      int height, bool withRGB,
+                                      const Eigen::Matrix3f &K, const float *G);
+  // maps an existing [file]. returns 0 if it can't be used.
+  static PackedSequence *openReader(const std::string &file);
+  ~PackedSequence();
+
+  // appends one image. writer only.
+  void write(const ImageAndExposure *image, const std::string &prefix);
+
+  // image [id] as views into the mapping (nothing is copied; the returned
+  // object does not own its memory). reader only.
+  ImageAndExposure *getImage(int id) const;
+  inline const PackedImageInfo &getInfo(int id) const { return infos[id]; }
+  std::string getPrefix(int id) const;
+
+  inline int getNumImages() const { return (int)infos.size(); }
+  inline const PackedSequenceHeader &getHeader() const { return header; }
+
+private:
+  PackedSequence();
+  size_t imageBytes() const;
+
+  std::string filename;
+  PackedSequenceHeader header;
+  std::vector<PackedImageInfo> infos;
+
+  // writer
+  FILE *outFile;
+  std::string prefixes;
+
+  // reader
+  const char *strings;
+  char *mapped;
+  size_t mappedSize;
+};
+
+} // namespace dso
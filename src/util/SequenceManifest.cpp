@@ -0,0 +1,253 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "util/SequenceManifest.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dso {
+
+static const char manifestMagic[8] = {'D', 'S', 'O', 'M', 'A', 'N', 'I', 0};
+// 2: names relative to the image folder (1 stored them as listed, including
+// the path the folder was given with).
+static const int32_t manifestVersion = 2;
+
+// modification time and size of [file], -1 if it doesn't exist.
+static void statFile(const std::string &file, int64_t &mtime, int64_t &size) {
+  struct stat st;
+  if (stat(file.c_str(), &st) != 0) {
+    mtime = size = -1;
+    return;
+  }
+  mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  size = st.st_size;
+}
+
+SequenceManifest::SequenceManifest() {
+  memset(&header, 0, sizeof(SequenceManifestHeader));
+  entries = 0;
+  strings = 0;
+  mapped = 0;
+  mappedSize = 0;
+}
+
+SequenceManifest::~SequenceManifest() {
+  if (mapped != 0)
+    munmap(mapped, mappedSize);
+}
+
+SequenceManifest *SequenceManifest::open(const std::string &file,
+                                         const std::string &source,
+                                         const std::string &timesFile,
+                                         const std::string &base) {
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return 0;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < (off_t)sizeof(SequenceManifestHeader)) {
+    close(fd);
+    return 0;
+  }
+
+  size_t size = st.st_size;
+  void *mem = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    printf("SequenceManifest: mmap of %s failed!\n", file.c_str());
+    return 0;
+  }
+
+  SequenceManifest *manifest = new SequenceManifest();
+  manifest->filename = file;
+  manifest->base = base;
+  manifest->mapped = (char *)mem;
+  manifest->mappedSize = size;
+  memcpy(&manifest->header, mem, sizeof(SequenceManifestHeader));
+
+  const SequenceManifestHeader &h = manifest->header;
+  if (memcmp(h.magic, manifestMagic, 8) != 0 ||
+      h.version != manifestVersion || h.numImages < 0 ||
+      h.numTimestamps < 0 || h.numExposures < 0 ||
+      h.entriesOffset < (int64_t)sizeof(SequenceManifestHeader) ||
+      h.entriesOffset + h.numImages * sizeof(SequenceManifestEntry) > size ||
+      h.timestampsOffset + h.numTimestamps * sizeof(double) > size ||
+      h.exposuresOffset + h.numExposures * sizeof(float) > size ||
+      h.stringsOffset < 0 || h.stringsSize < 0 ||
+      (size_t)(h.stringsOffset + h.stringsSize) > size) {
+    printf("SequenceManifest: %s is broken or of another version, "
+           "regenerating.\n",
+           file.c_str());
+    delete manifest;
+    return 0;
+  }
+
+  // a few stat calls instead of listing the directory.
+  int64_t sourceMtime, sourceSize, timesMtime, timesSize;
+  statFile(source, sourceMtime, sourceSize);
+  statFile(timesFile, timesMtime, timesSize);
+  if (sourceMtime != h.sourceMtime || sourceSize != h.sourceSize ||
+      timesMtime != h.timesMtime || timesSize != h.timesSize) {
+    printf("SequenceManifest: %s is out of date, regenerating.\n",
+           file.c_str());
+    delete manifest;
+    return 0;
+  }
+
+  manifest->entries =
+      (const SequenceManifestEntry *)(manifest->mapped + h.entriesOffset);
+  manifest->strings = manifest->mapped + h.stringsOffset;
+  printf("SequenceManifest: %d images from %s\n", h.numImages, file.c_str());
+  return manifest;
+}
+
+bool SequenceManifest::write(const std::string &file, const std::string &source,
+                             const std::string &timesFile,
+                             const std::string &base,
+                             const std::vector<std::string> &files,
+                             const std::vector<double> &timestamps,
+                             const std::vector<float> &exposures) {
+  SequenceManifestHeader h;
+  memset(&h, 0, sizeof(SequenceManifestHeader));
+  memcpy(h.magic, manifestMagic, 8);
+  h.version = manifestVersion;
+  h.numImages = (int)files.size();
+  h.numTimestamps = (int)timestamps.size();
+  h.numExposures = (int)exposures.size();
+  statFile(source, h.sourceMtime, h.sourceSize);
+  statFile(timesFile, h.timesMtime, h.timesSize);
+
+  std::vector<std::string> names(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i].compare(0, base.size(), base) != 0) {
+      printf("SequenceManifest: %s is not in %s, continuing without.\n",
+             files[i].c_str(), base.c_str());
+      return false;
+    }
+    names[i] = files[i].substr(base.size());
+  }
+
+  std::vector<SequenceManifestEntry> table(names.size());
+  int64_t stringsSize = 0;
+  for (size_t i = 0; i < names.size(); i++) {
+    const std::string &name = names[i];
+    size_t slash = name.find_last_of('/');
+    size_t start = slash == std::string::npos ? 0 : slash + 1;
+    size_t dot = name.find_last_of('.');
+    size_t end = (dot == std::string::npos || dot <= start) ? name.size() : dot;
+
+    SequenceManifestEntry &e = table[i];
+    memset(&e, 0, sizeof(SequenceManifestEntry));
+    e.nameOffset = stringsSize;
+    e.nameLength = (int)name.size();
+    e.stemStart = (int)start;
+    e.stemLength = (int)(end - start);
+    stringsSize += name.size();
+  }
+
+  h.entriesOffset = sizeof(SequenceManifestHeader);
+  h.timestampsOffset =
+      h.entriesOffset + files.size() * sizeof(SequenceManifestEntry);
+  h.exposuresOffset = h.timestampsOffset + timestamps.size() * sizeof(double);
+  h.stringsOffset = h.exposuresOffset + exposures.size() * sizeof(float);
+  h.stringsSize = stringsSize;
+
+  // written under a temporary name, so a concurrent or interrupted run never
+  // sees half a manifest.
+  std::string tmpFile = file + ".tmp" + std::to_string(getpid());
+  FILE *f = fopen(tmpFile.c_str(), "wb");
+  if (f == 0) {
+    printf("SequenceManifest: cannot write %s, continuing without.\n",
+           file.c_str());
+    return false;
+  }
+  bool ok = fwrite(&h, sizeof(SequenceManifestHeader), 1, f) == 1;
+  if (files.size() > 0)
+    ok &= fwrite(table.data(), sizeof(SequenceManifestEntry), table.size(),
+                 f) == table.size();
+  if (timestamps.size() > 0)
+    ok &= fwrite(timestamps.data(), sizeof(double), timestamps.size(), f) ==
+          timestamps.size();
+  if (exposures.size() > 0)
+    ok &= fwrite(exposures.data(), sizeof(float), exposures.size(), f) ==
+          exposures.size();
+  for (size_t i = 0; i < names.size() && ok; i++)
+    ok &= fwrite(names[i].data(), 1, names[i].size(), f) == names[i].size();
+  ok &= fclose(f) == 0;
+
+  if (!ok || rename(tmpFile.c_str(), file.c_str()) != 0) {
+    printf("SequenceManifest: cannot write %s, continuing without.\n",
+           file.c_str());
+    unlink(tmpFile.c_str());
+    return false;
+  }
+  printf("SequenceManifest: wrote %d images to %s\n", h.numImages,
+         file.c_str());
+  return true;
+}
+
+const SequenceManifestEntry &SequenceManifest::getEntry(int id) const {
+  if (id < 0 || id >= header.numImages) {
+    printf("SequenceManifest: image %d out of range (%d images)!\n", id,
+           header.numImages);
+    exit(1);
+  }
+  const SequenceManifestEntry &e = entries[id];
+  if (e.nameOffset < 0 || e.nameLength < 0 ||
+      e.nameOffset + e.nameLength > header.stringsSize || e.stemStart < 0 ||
+      e.stemLength < 0 || e.stemStart + e.stemLength > e.nameLength) {
+    printf("SequenceManifest: entry %d of %s is broken! delete the file to "
+           "regenerate it.\n",
+           id, filename.c_str());
+    exit(1);
+  }
+  return e;
+}
+
+std::string SequenceManifest::getFile(int id) const {
+  const SequenceManifestEntry &e = getEntry(id);
+  return base + std::string(strings + e.nameOffset, e.nameLength);
+}
+
+std::string SequenceManifest::getPrefix(int id) const {
+  const SequenceManifestEntry &e = getEntry(id);
+  return std::string(strings + e.nameOffset + e.stemStart, e.stemLength);
+}
+
+void SequenceManifest::getTimestamps(std::vector<double> &timestamps,
+                                     std::vector<float> &exposures) const {
+  const double *t = (const double *)(mapped + header.timestampsOffset);
+  const float *e = (const float *)(mapped + header.exposuresOffset);
+  timestamps.assign(t, t + header.numTimestamps);
+  exposures.assign(e, e + header.numExposures);
+}
+
+} // namespace dso
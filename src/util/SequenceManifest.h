@@ -0,0 +1,105 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace dso {
+
+struct SequenceManifestHeader {
+  char magic[8]; // "DSOMANI\0"
+  int32_t version;
+  int32_t numImages;
+  int32_t numTimestamps; // 0 if there is no (usable) times.txt
+  int32_t numExposures;  // 0 if the exposures are not usable
+  // what the manifest was generated from (st_mtim in ns, st_size; -1 if
+  // missing). if either changed, the manifest is regenerated.
+  int64_t sourceMtime, sourceSize;
+  int64_t timesMtime, timesSize;
+  int64_t entriesOffset;    // SequenceManifestEntry[numImages]
+  int64_t timestampsOffset; // double[numTimestamps]
+  int64_t exposuresOffset;  // float[numExposures]
+  int64_t stringsOffset, stringsSize;
+};
+
+struct SequenceManifestEntry {
+  int64_t nameOffset; // into the strings, not 0-terminated. relative to the
+                      // base directory the manifest is opened with.
+  int32_t nameLength;
+  int32_t stemStart; // prefix (file name without extension), relative to name
+  int32_t stemLength;
+  int32_t reserved;
+};
+
+// the file list, timestamps and exposures of an image folder or .zip,
+// generated once and memory-mapped on later runs, so startup neither lists
+// nor sorts the directory nor parses times.txt.
+//
+// only the header and the sizes of the tables are checked when opening;
+// entries are checked when they are accessed.
+class SequenceManifest {
+public:
+  // maps [file], if it was generated from [source] and [timesFile] as they
+  // are now. returns 0 otherwise (missing, stale or broken).
+  // getFile() returns the stored names with [base] prepended, so the same
+  // folder can be reached through any path.
+  static SequenceManifest *open(const std::string &file,
+                                const std::string &source,
+                                const std::string &timesFile,
+                                const std::string &base);
+  // writes the manifest for [source] (sorted [files] and their timestamps /
+  // exposures as loaded from [timesFile]). [files] all start with [base],
+  // which is not stored. returns false if it can't.
+  static bool write(const std::string &file, const std::string &source,
+                    const std::string &timesFile, const std::string &base,
+                    const std::vector<std::string> &files,
+                    const std::vector<double> &timestamps,
+                    const std::vector<float> &exposures);
+  ~SequenceManifest();
+
+  inline int getNumImages() const { return header.numImages; }
+  std::string getFile(int id) const;
+  std::string getPrefix(int id) const;
+  void getTimestamps(std::vector<double> &timestamps,
+                     std::vector<float> &exposures) const;
+
+private:
+  SequenceManifest();
+  const SequenceManifestEntry &getEntry(int id) const;
+
+  std::string filename;
+  std::string base;
+  SequenceManifestHeader header;
+  const SequenceManifestEntry *entries;
+  const char *strings;
+
+  char *mapped;
+  size_t mappedSize;
+};
+
+} // namespace dso
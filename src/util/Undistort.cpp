@@ -31,8 +31,11 @@
 #include "util/globalFuncs.h"
 #include "util/settings.h"
 #include <Eigen/Core>
+#include <algorithm>
 #include <iterator>
 
+#include "util/UndistortKernels.h"
+
 namespace dso {
 
 PhotometricUndistorter::PhotometricUndistorter(std::string file,
@@ -191,9 +194,43 @@ void PhotometricUndistorter::unMapFloatImage(float *image) {
   }
 }
 
+void PhotometricUndistorter::getPhotometricMaps(
+    float exposure_time, const float *&lut, const float *&vignetteInv) const {
+  if (!valid || exposure_time <= 0 || setting_photometricCalibration == 0) {
+    lut = vignetteInv = 0;
+    return;
+  }
+
+  lut = G;
+  vignetteInv = setting_photometricCalibration == 2 ? vignetteMapInv : 0;
+}
+
+float *PhotometricUndistorter::makeReducedVignetteInv(int f, int w_,
+                                                      int h_) const {
+  if (!valid)
+    return 0;
+
+  float *inv = new float[w_ * h_];
+  for (int y = 0; y < h_; y++)
+    for (int x = 0; x < w_; x++) {
+      // the block may be cut off at the right / bottom border.
+      float sum = 0;
+      int num = 0;
+      for (int dy = 0; dy < f && y * f + dy < h; dy++)
+        for (int dx = 0; dx < f && x * f + dx < w; dx++) {
+          sum += vignetteMap[x * f + dx + (y * f + dy) * w];
+          num++;
+        }
+      inv[x + y * w_] = num / sum;
+    }
+  return inv;
+}
+
 void PhotometricUndistorter::minimalProcessFrame(unsigned char *image_in,
                                                  float exposure_time,
-                                                 float factor) {
+                                                 float factor,
+                                                 ImageAndExposure *out) {
+  ImageAndExposure *output = out != 0 ? out : this->output;
   int wh = w * h;
   float *data = output->image;
   assert(output->w == w && output->h == h);
@@ -212,7 +249,8 @@ void PhotometricUndistorter::minimalProcessFrame(unsigned char *image_in,
 
 template <typename T>
 void PhotometricUndistorter::processFrame(T *image_in, float exposure_time,
-                                          float factor) {
+                                          float factor, ImageAndExposure *out) {
+  ImageAndExposure *output = out != 0 ? out : this->output;
   int wh = w * h;
   float *data = output->image;
   assert(output->w == w && output->h == h);
@@ -228,13 +266,13 @@ void PhotometricUndistorter::processFrame(T *image_in, float exposure_time,
     output->exposure_time = exposure_time;
     output->timestamp = 0;
   } else {
-    for (int i = 0; i < wh; i++) {
-      data[i] = G[image_in[i]];
-    }
-
+    // response and vignette in a single pass over the image.
     if (setting_photometricCalibration == 2) {
       for (int i = 0; i < wh; i++)
-        data[i] *= vignetteMapInv[i];
+        data[i] = G[image_in[i]] * vignetteMapInv[i];
+    } else {
+      for (int i = 0; i < wh; i++)
+        data[i] = G[image_in[i]];
     }
 
     output->exposure_time = exposure_time;
@@ -245,15 +283,23 @@ void PhotometricUndistorter::processFrame(T *image_in, float exposure_time,
     output->exposure_time = 1;
 }
 template void PhotometricUndistorter::processFrame<unsigned char>(
-    unsigned char *image_in, float exposure_time, float factor);
+    unsigned char *image_in, float exposure_time, float factor,
+    ImageAndExposure *out);
 template void PhotometricUndistorter::processFrame<unsigned short>(
-    unsigned short *image_in, float exposure_time, float factor);
+    unsigned short *image_in, float exposure_time, float factor,
+    ImageAndExposure *out);
 
 Undistort::~Undistort() {
   if (remapX != 0)
     delete[] remapX;
   if (remapY != 0)
     delete[] remapY;
+  if (remapTable != 0)
+    delete[] remapTable;
+  if (remapTableReduced != 0)
+    delete[] remapTableReduced;
+  if (vignetteInvReduced != 0)
+    delete[] vignetteInvReduced;
 }
 
 Undistort *Undistort::getUndistorterForFile(std::string configFilename,
@@ -375,6 +421,110 @@ void Undistort::loadPhotometricCalibration(std::string file,
   photometricUndist =
       new PhotometricUndistorter(file, noiseImage, vignetteImage,
                                  getOriginalSize()[0], getOriginalSize()[1]);
+  if (reducedFactor > 1)
+    vignetteInvReduced = photometricUndist->makeReducedVignetteInv(
+        reducedFactor, wReduced, hReduced);
+}
+
+// remap kernels, consuming the compact remapTable. the output is walked in
+// tiles of remapTileRows x remapTileCols, so the source rows a tile reads
+// stay in cache also for strongly distorted (wide-angle) images.
+static const int remapTileRows = 16;
+static const int remapTileCols = 256;
+
+template <typename F> static void forEachRemapSpan(int w, int h, F kernel) {
+  for (int y0 = 0; y0 < h; y0 += remapTileRows)
+    for (int x0 = 0; x0 < w; x0 += remapTileCols) {
+      int n = std::min(remapTileCols, w - x0);
+      for (int y = y0; y < std::min(h, y0 + remapTileRows); y++)
+        kernel(x0 + y * w, n);
+    }
+}
+
+// irradiance of raw pixel [i]: response (or factor) and vignette.
+template <typename T>
+static inline float irradiance(const T *in, int i, const float *lut,
+                               float factor, const float *vignetteInv) {
+  float v = lut != 0 ? lut[in[i]] : factor * in[i];
+  return vignetteInv != 0 ? v * vignetteInv[i] : v;
+}
+
+// the wide kernel for [in]'s pixel type, see UndistortKernels.h.
+static inline int remapPhotometricWide(const RemapEntry *table, int n,
+                                       const unsigned char *in, int wOrg,
+                                       int numPixOrg, const float *lut,
+                                       float factor, const float *vignetteInv,
+                                       float *out) {
+  RemapPhotometric8Kernel k = getUndistortKernels().remapPhotometric8;
+  return k != 0 ? k(table, n, in, wOrg, numPixOrg, lut, factor, vignetteInv,
+                    out)
+                : 0;
+}
+static inline int remapPhotometricWide(const RemapEntry *table, int n,
+                                       const unsigned short *in, int wOrg,
+                                       int numPixOrg, const float *lut,
+                                       float factor, const float *vignetteInv,
+                                       float *out) {
+  RemapPhotometric16Kernel k = getUndistortKernels().remapPhotometric16;
+  return k != 0 ? k(table, n, in, wOrg, numPixOrg, lut, factor, vignetteInv,
+                    out)
+                : 0;
+}
+
+// out[i] = bilinear interpolation of the irradiance of the raw image [in]
+// at table[i], i < n. the photometric correction is applied to the four taps
+// (as processFrame would to the whole image), so no intermediate float image
+// is needed. [lut] = response (0: factor*v), [vignetteInv] may be 0.
+template <typename T>
+static void remapPhotometricKernel(const RemapEntry *table, int n,
+                                   const T *in, int wOrg, int numPixOrg,
+                                   const float *lut, float factor,
+                                   const float *vignetteInv, float *out) {
+  // the first pixels 8 at a time, if the CPU can.
+  int i = remapPhotometricWide(table, n, in, wOrg, numPixOrg, lut, factor,
+                               vignetteInv, out);
+  for (; i < n; i++) {
+    const RemapEntry &e = table[i];
+    if (e.offset < 0) {
+      out[i] = 0;
+      continue;
+    }
+    float xx = e.wx * remapWeightScale;
+    float yy = e.wy * remapWeightScale;
+    float xxyy = xx * yy;
+    int o = e.offset;
+    out[i] =
+        xxyy * irradiance(in, o + 1 + wOrg, lut, factor, vignetteInv) +
+        (yy - xxyy) * irradiance(in, o + wOrg, lut, factor, vignetteInv) +
+        (xx - xxyy) * irradiance(in, o + 1, lut, factor, vignetteInv) +
+        (1 - xx - yy + xxyy) * irradiance(in, o, lut, factor, vignetteInv);
+  }
+}
+
+// fused kernel of Undistort::undistortBGR, for n pixels of [table]:
+// [gray] = remapped irradiance of the gray image, [rgb] = remapped color,
+// interleaved RGB. [numPixOrg] = wOrg*hOrg, the size of [in] in pixels.
+static void remapBGRKernel(const RemapEntry *table, int n,
+                           const unsigned char *in, int wOrg, int numPixOrg,
+                           const float *lut, const float *vignetteInv,
+                           float factor, float *gray, float *rgb) {
+  int i = 0;
+  // the first pixels 8 at a time, if the CPU can.
+  if (getUndistortKernels().remapBGR != 0)
+    i = getUndistortKernels().remapBGR(table, n, in, wOrg, numPixOrg, lut,
+                                       vignetteInv, factor, gray, rgb);
+  for (; i < n; i++)
+    remapBGRPixel(table[i], in, wOrg, lut, vignetteInv, factor, gray + i,
+                  rgb + 3 * i);
+}
+
+template <typename T>
+void Undistort::remapPhotometric(const T *in, const float *lut, float factor,
+                                 const float *vignetteInv, float *out) const {
+  forEachRemapSpan(w, h, [&](int idx, int n) {
+    remapPhotometricKernel(remapTable + idx, n, in, wOrg, wOrg * hOrg, lut,
+                           factor, vignetteInv, out + idx);
+  });
 }
 
 template <typename T>
@@ -387,13 +537,32 @@ ImageAndExposure *Undistort::undistort(const MinimalImage<T> *image_raw,
     exit(1);
   }
 
-  photometricUndist->processFrame<T>(image_raw->data, exposure, factor);
   ImageAndExposure *result = new ImageAndExposure(w, h, timestamp);
-  photometricUndist->output->copyMetaTo(*result);
+
+  if (benchmark_varNoise == 0) {
+    if (passthrough) {
+      photometricUndist->processFrame<T>(image_raw->data, exposure, factor,
+                                         result);
+      result->timestamp = timestamp;
+    } else {
+      const float *lut, *vignetteInv;
+      photometricUndist->getPhotometricMaps(exposure, lut, vignetteInv);
+      result->exposure_time = setting_useExposure ? exposure : 1;
+      remapPhotometric(image_raw->data, lut, factor, vignetteInv,
+                       result->image);
+    }
+    applyBlurNoise(result->image);
+    return result;
+  }
+
+  ImageAndExposure photometric(wOrg, hOrg);
+  photometricUndist->processFrame<T>(image_raw->data, exposure, factor,
+                                     &photometric);
+  photometric.copyMetaTo(*result);
 
   if (!passthrough) {
     float *out_data = result->image;
-    float *in_data = photometricUndist->output->image;
+    float *in_data = photometric.image;
 
     float *noiseMapX = 0;
     float *noiseMapY = 0;
@@ -467,7 +636,7 @@ ImageAndExposure *Undistort::undistort(const MinimalImage<T> *image_raw,
     }
 
   } else {
-    memcpy(result->image, photometricUndist->output->image,
+    memcpy(result->image, photometric.image,
            sizeof(float) * w * h);
   }
 
@@ -492,14 +661,29 @@ cv::Mat Undistort::undistortSingleChannel(const cv::Mat *image_raw,
            image_raw->cols, image_raw->rows, wOrg, hOrg);
     exit(1);
   }
-  photometricUndist->minimalProcessFrame(image_raw->data, exposure, factor);
-  ImageAndExposure *result = new ImageAndExposure(w, h, timestamp);
-  photometricUndist->output->copyMetaTo(*result);
+  cv::Mat result = BufferPool::instance().getMat(h, w, CV_32F);
+
+  if (benchmark_varNoise == 0) {
+    cv::Mat input = image_raw->isContinuous() ? *image_raw : image_raw->clone();
+    if (passthrough) {
+      float *out_data = (float *)result.data;
+      for (int idx = 0; idx < w * h; idx++)
+        out_data[idx] = factor * input.data[idx];
+    } else {
+      remapPhotometric<unsigned char>(input.data, 0, factor, 0,
+                                      (float *)result.data);
+    }
+    return result;
+  }
+
+  ImageAndExposure photometric(wOrg, hOrg);
+  photometricUndist->minimalProcessFrame(image_raw->data, exposure, factor,
+                                         &photometric);
 
   if (!passthrough) {
 
-    float *out_data = result->image;
-    float *in_data = photometricUndist->output->image;
+    float *out_data = (float *)result.data;
+    float *in_data = photometric.image;
     float *noiseMapX = 0;
     float *noiseMapY = 0;
     if (benchmark_varNoise > 0) {
@@ -572,11 +756,87 @@ cv::Mat Undistort::undistortSingleChannel(const cv::Mat *image_raw,
     }
 
   } else {
-    memcpy(result->image, photometricUndist->output->image,
+    memcpy(result.data, photometric.image,
            sizeof(float) * w * h);
   }
 
-  return cv::Mat(h, w, CV_32F, result->image);
+  return result;
+}
+
+ImageAndExposure *Undistort::undistortBGR(const cv::Mat &bgr, float exposure,
+                                          double timestamp,
+                                          float factor) const {
+  bool reduced = reducedFactor > 1 && bgr.cols == wReduced &&
+                 bgr.rows == hReduced;
+  if ((!reduced && (bgr.cols != wOrg || bgr.rows != hOrg)) ||
+      bgr.type() != CV_8UC3) {
+    printf("Undistort::undistortBGR: wrong image size / type (%d %d instead of "
+           "%d %d, 8-bit BGR) \n",
+           bgr.cols, bgr.rows, wOrg, hOrg);
+    exit(1);
+  }
+
+  if (benchmark_varNoise > 0) {
+    // the remap is perturbed per frame: go through the generic path.
+    cv::Mat gray;
+    cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+    MinimalImageB minimg(gray.cols, gray.rows);
+    memcpy(minimg.data, gray.data, gray.rows * gray.cols);
+    ImageAndExposure *result =
+        undistort<unsigned char>(&minimg, exposure, timestamp, factor);
+
+    std::vector<cv::Mat> channels(3);
+    for (int c = 0; c < 3; c++) {
+      cv::Mat channel;
+      cv::extractChannel(bgr, channel, c);
+      channels[2 - c] =
+          undistortSingleChannel(&channel, exposure, timestamp, factor);
+    }
+    cv::merge(channels, result->rgb_image);
+    return result;
+  }
+
+  cv::Mat input = bgr.isContinuous() ? bgr : bgr.clone();
+  const unsigned char *in = input.data;
+
+  float identity[256];
+  const float *lut, *vignetteInv;
+  photometricUndist->getPhotometricMaps(exposure, lut, vignetteInv);
+  if (lut == 0) {
+    for (int i = 0; i < 256; i++)
+      identity[i] = factor * i;
+    lut = identity;
+  }
+  if (reduced && vignetteInv != 0)
+    vignetteInv = vignetteInvReduced;
+
+  ImageAndExposure *result = new ImageAndExposure(w, h, timestamp);
+  result->exposure_time = setting_useExposure ? exposure : 1;
+  result->rgb_image = BufferPool::instance().getMat(h, w, CV_32FC3);
+  float *out_gray = result->image;
+  float *out_rgb = (float *)result->rgb_image.data;
+
+  if (passthrough) {
+    for (int idx = 0; idx < w * h; idx++) {
+      float v = lut[bgrToGray(in + 3 * idx)];
+      out_gray[idx] = vignetteInv != 0 ? v * vignetteInv[idx] : v;
+      out_rgb[3 * idx] = factor * in[3 * idx + 2];
+      out_rgb[3 * idx + 1] = factor * in[3 * idx + 1];
+      out_rgb[3 * idx + 2] = factor * in[3 * idx];
+    }
+  } else {
+    const RemapEntry *table = reduced ? remapTableReduced : remapTable;
+    int wIn = bgr.cols;
+    int hIn = bgr.rows;
+    forEachRemapSpan(w, h, [&](int idx, int n) {
+      remapBGRKernel(table + idx, n, in, wIn, wIn * hIn, lut, vignetteInv,
+                     factor, out_gray + idx, out_rgb + 3 * idx);
+    });
+  }
+
+  applyBlurNoise(result->image);
+
+  return result;
 }
 
 void Undistort::applyBlurNoise(float *img) const {
@@ -799,6 +1059,11 @@ void Undistort::readFromFile(const char *configFileName, int nPars,
   passthrough = false;
   remapX = 0;
   remapY = 0;
+  remapTable = 0;
+  remapTableReduced = 0;
+  vignetteInvReduced = 0;
+  reducedFactor = 1;
+  wReduced = hReduced = 0;
 
   float outputCalibration[5];
 
@@ -988,9 +1253,9 @@ void Undistort::readFromFile(const char *configFileName, int nPars,
       if (ix == wOrg - 1)
         ix = wOrg - 1.001;
       if (iy == hOrg - 1)
-        ix = hOrg - 1.001;
+        iy = hOrg - 1.001;
 
-      if (ix > 0 && iy > 0 && ix < wOrg - 1 && iy < wOrg - 1) {
+      if (ix > 0 && iy > 0 && ix < wOrg - 1 && iy < hOrg - 1) {
         remapX[x + y * w] = ix;
         remapY[x + y * w] = iy;
       } else {
@@ -999,6 +1264,61 @@ void Undistort::readFromFile(const char *configFileName, int nPars,
       }
     }
 
+  // the same in fixed point, for the remap kernels. remapX / remapY stay for
+  // the benchmark noise, which perturbs the coordinates per frame.
+  remapTable = new RemapEntry[w * h];
+  for (int idx = 0; idx < w * h; idx++) {
+    RemapEntry &e = remapTable[idx];
+    float ix = remapX[idx];
+    float iy = remapY[idx];
+    if (ix < 0) {
+      e.offset = -1;
+      e.wx = e.wy = 0;
+      continue;
+    }
+    int ixi = ix;
+    int iyi = iy;
+    e.offset = ixi + iyi * wOrg;
+    e.wx = (uint16_t)std::min(32768L, lrintf((ix - ixi) * 32768));
+    e.wy = (uint16_t)std::min(32768L, lrintf((iy - iyi) * 32768));
+  }
+
+  // largest reduced decode that still has at least the output resolution. the
+  // reduced image (JPEG: rounded up) has its pixel x at x*f + (f-1)/2 in the
+  // original, so the remap is folded into x' = (x - (f-1)/2) / f.
+  if (!passthrough && benchmark_varNoise == 0) {
+    for (int f = 8; f >= 2; f /= 2)
+      if (wOrg / f >= w && hOrg / f >= h) {
+        reducedFactor = f;
+        break;
+      }
+  }
+  if (reducedFactor > 1) {
+    int f = reducedFactor;
+    wReduced = (wOrg + f - 1) / f;
+    hReduced = (hOrg + f - 1) / f;
+    remapTableReduced = new RemapEntry[w * h];
+    for (int idx = 0; idx < w * h; idx++) {
+      RemapEntry &e = remapTableReduced[idx];
+      if (remapX[idx] < 0) {
+        e.offset = -1;
+        e.wx = e.wy = 0;
+        continue;
+      }
+      float ix = (remapX[idx] - 0.5f * (f - 1)) / f;
+      float iy = (remapY[idx] - 0.5f * (f - 1)) / f;
+      ix = std::max(0.0f, std::min(ix, wReduced - 1.001f));
+      iy = std::max(0.0f, std::min(iy, hReduced - 1.001f));
+      int ixi = ix;
+      int iyi = iy;
+      e.offset = ixi + iyi * wReduced;
+      e.wx = (uint16_t)std::min(32768L, lrintf((ix - ixi) * 32768));
+      e.wy = (uint16_t)std::min(32768L, lrintf((iy - iyi) * 32768));
+    }
+    printf("input can be decoded at 1/%d resolution (%d x %d).\n", f,
+           wReduced, hReduced);
+  }
+
   valid = true;
 
   printf("\nRectified Kamera Matrix:\n");
@@ -27,7 +27,9 @@
 #include "util/ImageAndExposure.h"
 #include "util/MinimalImage.h"
 #include "util/NumType.h"
+#include "util/UndistortKernels.h"
 #include "Eigen/Core"
+#include <stdint.h>
 
 
 
@@ -36,7 +38,6 @@
 namespace dso
 {
 
-
 class PhotometricUndistorter
 {
 public:
@@ -47,10 +48,17 @@ public:
 	// removes readout noise, and converts to irradiance.
 	// affine normalizes values to 0 <= I < 256.
 	// raw irradiance = a*I + b.
-	// output will be written in [output].
-	template<typename T> void processFrame(T* image_in, float exposure_time, float factor=1);
-	void minimalProcessFrame(unsigned char* image_in, float exposure_time, float factor=1);
+	// output will be written in [out], or in [output] if none is given
+	// (only the former is safe to call from several threads at once).
+	template<typename T> void processFrame(T* image_in, float exposure_time, float factor=1, ImageAndExposure* out=0);
+	void minimalProcessFrame(unsigned char* image_in, float exposure_time, float factor=1, ImageAndExposure* out=0);
 	void unMapFloatImage(float* image);
+	// what processFrame does, for kernels of their own: [lut] maps raw values to irradiance
+	// (0: factor*value), [vignetteInv] is the per-pixel factor on top (0: none).
+	void getPhotometricMaps(float exposure_time, const float*& lut, const float*& vignetteInv) const;
+	// vignetteMapInv for images decoded at 1/f resolution (w_ x h_): inverse of the block-averaged
+	// vignette. 0 if there is none.
+	float* makeReducedVignetteInv(int f, int w_, int h_) const;
 
 	ImageAndExposure* output;
 
@@ -79,10 +87,19 @@ public:
 	inline const VecX getOriginalParameter() const {return parsOrg;};
 	inline const Eigen::Vector2i getOriginalSize() {return Eigen::Vector2i(wOrg,hOrg);};
 	inline bool isValid() {return valid;};
+	// > 1 if the output is small enough for decoding the input at 1/getReducedFactor() of its
+	// resolution (JPEG DCT scaling, size getReducedSize()); undistortBGR takes those as well.
+	inline int getReducedFactor() const {return reducedFactor;};
+	inline const Eigen::Vector2i getReducedSize() const {return Eigen::Vector2i(wReduced,hReduced);};
 
+	// both are reentrant: the photometric step goes into a per-call buffer.
 	template<typename T>
 	ImageAndExposure* undistort(const MinimalImage<T>* image_raw, float exposure=0, double timestamp=0, float factor=1) const;
 	cv::Mat undistortSingleChannel(const cv::Mat* image_raw, float exposure=0, double timestamp=0, float factor=1) const;
+	// interleaved 8-bit BGR in, one pass over the remap table: [image] is the photometrically
+	// corrected irradiance of its gray image (same as undistort<unsigned char> on cv::COLOR_BGR2GRAY),
+	// [rgb_image] the undistorted color image (RGB, CV_32FC3, 0..255; same as undistortSingleChannel).
+	ImageAndExposure* undistortBGR(const cv::Mat& bgr, float exposure=0, double timestamp=0, float factor=1) const;
 	static Undistort* getUndistorterForFile(std::string configFilename, std::string gammaFilename, std::string vignetteFilename);
 
 	void loadPhotometricCalibration(std::string file, std::string noiseImage, std::string vignetteImage);
@@ -99,6 +116,17 @@ protected:
 
 	float* remapX;
 	float* remapY;
+	RemapEntry* remapTable;
+
+	// the same for the reduced input: remap and vignette at wReduced x hReduced.
+	int reducedFactor, wReduced, hReduced;
+	RemapEntry* remapTableReduced;
+	float* vignetteInvReduced;
+
+	// [out] (w x h) = irradiance of the raw image [in] (wOrg x hOrg) sampled through remapTable;
+	// [lut], [factor] and [vignetteInv] as from PhotometricUndistorter::getPhotometricMaps.
+	template<typename T>
+	void remapPhotometric(const T* in, const float* lut, float factor, const float* vignetteInv, float* out) const;
 
 	void applyBlurNoise(float* img) const;
 
@@ -0,0 +1,126 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+// AVX2 versions of the remap loops of Undistort. like the CoarseTracker
+// kernels, they are compiled with their own instruction set flags and chosen
+// at runtime, so this header must not pull in Eigen or anything else that has
+// inline code shared with the rest of the program.
+
+#include <stdint.h>
+
+namespace dso {
+
+// bilinear lookup for one output pixel, precomputed in Undistort::readFromFile:
+// source offset (x + y*wOrg) of the top-left tap, -1 if it falls outside the
+// image, and the fractional position in 1/32768.
+struct RemapEntry {
+  int32_t offset;
+  uint16_t wx, wy;
+};
+
+static const float remapWeightScale = 1.0f / 32768;
+
+// gray value as cv::COLOR_BGR2GRAY computes it for 8 bit.
+static inline int bgrToGray(const unsigned char *p) {
+  return (p[0] * 1868 + p[1] * 9617 + p[2] * 4899 + (1 << 13)) >> 14;
+}
+
+// one output pixel of Undistort::undistortBGR.
+static inline void remapBGRPixel(const RemapEntry &e, const unsigned char *in,
+                                 int wOrg, const float *lut,
+                                 const float *vignetteInv, float factor,
+                                 float *gray, float *rgb) {
+  if (e.offset < 0) {
+    *gray = rgb[0] = rgb[1] = rgb[2] = 0;
+    return;
+  }
+  float xx = e.wx * remapWeightScale;
+  float yy = e.wy * remapWeightScale;
+  float xxyy = xx * yy;
+  float w00 = 1 - xx - yy + xxyy, w10 = xx - xxyy, w01 = yy - xxyy,
+        w11 = xxyy;
+
+  int i00 = e.offset;
+  int i01 = e.offset + wOrg;
+  const unsigned char *p00 = in + 3 * i00;
+  const unsigned char *p01 = in + 3 * i01;
+  float g00 = lut[bgrToGray(p00)], g10 = lut[bgrToGray(p00 + 3)],
+        g01 = lut[bgrToGray(p01)], g11 = lut[bgrToGray(p01 + 3)];
+  if (vignetteInv != 0) {
+    g00 *= vignetteInv[i00];
+    g10 *= vignetteInv[i00 + 1];
+    g01 *= vignetteInv[i01];
+    g11 *= vignetteInv[i01 + 1];
+  }
+  *gray = w00 * g00 + w10 * g10 + w01 * g01 + w11 * g11;
+
+  for (int c = 0; c < 3; c++)
+    rgb[2 - c] = factor * (w00 * p00[c] + w10 * p00[c + 3] + w01 * p01[c] +
+                           w11 * p01[c + 3]);
+}
+
+// the wide kernels handle the first pixels of [table] (of [n]) 8 at a time and
+// return how many they did; the caller does the rest. arguments as for
+// remapPhotometricKernel / remapBGRKernel in Undistort.cpp.
+typedef int (*RemapPhotometric8Kernel)(const RemapEntry *table, int n,
+                                       const unsigned char *in, int wOrg,
+                                       int numPixOrg, const float *lut,
+                                       float factor, const float *vignetteInv,
+                                       float *out);
+typedef int (*RemapPhotometric16Kernel)(const RemapEntry *table, int n,
+                                        const unsigned short *in, int wOrg,
+                                        int numPixOrg, const float *lut,
+                                        float factor, const float *vignetteInv,
+                                        float *out);
+typedef int (*RemapBGRKernel)(const RemapEntry *table, int n,
+                              const unsigned char *in, int wOrg, int numPixOrg,
+                              const float *lut, const float *vignetteInv,
+                              float factor, float *gray, float *rgb);
+
+namespace avx2 {
+int remapPhotometric(const RemapEntry *table, int n, const unsigned char *in,
+                     int wOrg, int numPixOrg, const float *lut, float factor,
+                     const float *vignetteInv, float *out);
+int remapPhotometric(const RemapEntry *table, int n, const unsigned short *in,
+                     int wOrg, int numPixOrg, const float *lut, float factor,
+                     const float *vignetteInv, float *out);
+int remapBGR(const RemapEntry *table, int n, const unsigned char *in, int wOrg,
+             int numPixOrg, const float *lut, const float *vignetteInv,
+             float factor, float *gray, float *rgb);
+} // namespace avx2
+
+struct UndistortKernels {
+  // 0: none, scalar only.
+  RemapPhotometric8Kernel remapPhotometric8;
+  RemapPhotometric16Kernel remapPhotometric16;
+  RemapBGRKernel remapBGR;
+  const char *name;
+};
+
+// the widest kernels this CPU can run, picked on the first call.
+const UndistortKernels &getUndistortKernels();
+
+} // namespace dso
@@ -0,0 +1,241 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// compiled with -mavx2 -mfma (see CMakeLists.txt), only called if the CPU has them.
+#include "util/UndistortKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace dso {
+namespace avx2 {
+
+// 8 consecutive entries -> their offsets and weights (wx | wy << 16).
+static inline void loadRemapEntries(const RemapEntry *table, __m256i &offsets,
+                                    __m256i &weights) {
+  __m256 e0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)table));
+  __m256 e1 =
+      _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(table + 4)));
+  // shuffle_ps works per 128-bit lane (-> entries 0 1 4 5 2 3 6 7), reorder.
+  offsets = _mm256_permute4x64_epi64(
+      _mm256_castps_si256(_mm256_shuffle_ps(e0, e1, _MM_SHUFFLE(2, 0, 2, 0))),
+      _MM_SHUFFLE(3, 1, 2, 0));
+  weights = _mm256_permute4x64_epi64(
+      _mm256_castps_si256(_mm256_shuffle_ps(e0, e1, _MM_SHUFFLE(3, 1, 3, 1))),
+      _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// 8 raw pixels at [idx] -> their irradiance.
+template <typename T>
+static inline __m256 gatherIrradiance(const T *in, __m256i idx,
+                                      const float *lut, __m256 factor,
+                                      const float *vignetteInv) {
+  // gathers 4 bytes at in + idx, keeps the low sizeof(T) of them.
+  __m256i raw = _mm256_and_si256(
+      _mm256_i32gather_epi32((const int *)in, idx, sizeof(T)),
+      _mm256_set1_epi32(sizeof(T) == 1 ? 0xff : 0xffff));
+  __m256 v = lut != 0 ? _mm256_i32gather_ps(lut, raw, 4)
+                      : _mm256_mul_ps(_mm256_cvtepi32_ps(raw), factor);
+  if (vignetteInv != 0)
+    v = _mm256_mul_ps(v, _mm256_i32gather_ps(vignetteInv, idx, 4));
+  return v;
+}
+
+template <typename T>
+static int remapPhotometricT(const RemapEntry *table, int n, const T *in,
+                             int wOrg, int numPixOrg, const float *lut,
+                             float factor, const float *vignetteInv,
+                             float *out) {
+  int i = 0;
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 scale = _mm256_set1_ps(remapWeightScale);
+  const __m256 factor8 = _mm256_set1_ps(factor);
+  const __m256i mask16 = _mm256_set1_epi32(0xffff);
+  const __m256i minusOne = _mm256_set1_epi32(-1);
+  // the 4-byte gathers read up to 4 - sizeof(T) bytes past the last pixel.
+  const __m256i lastSafe =
+      _mm256_set1_epi32(numPixOrg - wOrg - 1 - 4 / sizeof(T));
+  for (; i + 8 <= n; i += 8) {
+    __m256i offsets, weights;
+    loadRemapEntries(table + i, offsets, weights);
+    if (_mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(offsets, lastSafe))))
+      break; // only the last rows of the image, finish them scalar.
+    __m256i valid = _mm256_cmpgt_epi32(offsets, minusOne);
+    offsets = _mm256_and_si256(offsets, valid); // invalid: read pixel 0.
+
+    __m256 xx = _mm256_mul_ps(
+        _mm256_cvtepi32_ps(_mm256_and_si256(weights, mask16)), scale);
+    __m256 yy =
+        _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(weights, 16)), scale);
+    __m256 xxyy = _mm256_mul_ps(xx, yy);
+
+    __m256 p00 = gatherIrradiance(in, offsets, lut, factor8, vignetteInv);
+    __m256 p10 = gatherIrradiance(
+        in, _mm256_add_epi32(offsets, _mm256_set1_epi32(1)), lut, factor8,
+        vignetteInv);
+    __m256 p01 = gatherIrradiance(
+        in, _mm256_add_epi32(offsets, _mm256_set1_epi32(wOrg)), lut, factor8,
+        vignetteInv);
+    __m256 p11 = gatherIrradiance(
+        in, _mm256_add_epi32(offsets, _mm256_set1_epi32(wOrg + 1)), lut,
+        factor8, vignetteInv);
+
+    __m256 res = _mm256_mul_ps(xxyy, p11);
+    res = _mm256_add_ps(res, _mm256_mul_ps(_mm256_sub_ps(yy, xxyy), p01));
+    res = _mm256_add_ps(res, _mm256_mul_ps(_mm256_sub_ps(xx, xxyy), p10));
+    res = _mm256_add_ps(
+        res, _mm256_mul_ps(
+                 _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), yy), xxyy),
+                 p00));
+    _mm256_storeu_ps(out + i, _mm256_and_ps(res, _mm256_castsi256_ps(valid)));
+  }
+  return i;
+}
+
+int remapPhotometric(const RemapEntry *table, int n, const unsigned char *in,
+                     int wOrg, int numPixOrg, const float *lut, float factor,
+                     const float *vignetteInv, float *out) {
+  return remapPhotometricT(table, n, in, wOrg, numPixOrg, lut, factor,
+                           vignetteInv, out);
+}
+
+int remapPhotometric(const RemapEntry *table, int n, const unsigned short *in,
+                     int wOrg, int numPixOrg, const float *lut, float factor,
+                     const float *vignetteInv, float *out) {
+  return remapPhotometricT(table, n, in, wOrg, numPixOrg, lut, factor,
+                           vignetteInv, out);
+}
+
+// 8 source pixels (BGR u8) at [idx] -> irradiance of their gray value, and
+// the three channels as float.
+static inline void gatherBGRTap(const unsigned char *in, __m256i idx,
+                                const float *lut, const float *vignetteInv,
+                                __m256 &irr, __m256 &b, __m256 &g, __m256 &r) {
+  const __m256i mask8 = _mm256_set1_epi32(0xff);
+  // 4 bytes at 3*idx: B, G, R and the next pixel's B.
+  __m256i px = _mm256_i32gather_epi32(
+      (const int *)in, _mm256_add_epi32(idx, _mm256_add_epi32(idx, idx)), 1);
+  __m256i bi = _mm256_and_si256(px, mask8);
+  __m256i gi = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask8);
+  __m256i ri = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask8);
+
+  __m256i grayi =
+      _mm256_add_epi32(_mm256_mullo_epi32(bi, _mm256_set1_epi32(1868)),
+                       _mm256_mullo_epi32(gi, _mm256_set1_epi32(9617)));
+  grayi = _mm256_add_epi32(
+      grayi, _mm256_add_epi32(_mm256_mullo_epi32(ri, _mm256_set1_epi32(4899)),
+                              _mm256_set1_epi32(1 << 13)));
+  irr = _mm256_i32gather_ps(lut, _mm256_srli_epi32(grayi, 14), 4);
+  if (vignetteInv != 0)
+    irr = _mm256_mul_ps(irr, _mm256_i32gather_ps(vignetteInv, idx, 4));
+
+  b = _mm256_cvtepi32_ps(bi);
+  g = _mm256_cvtepi32_ps(gi);
+  r = _mm256_cvtepi32_ps(ri);
+}
+
+int remapBGR(const RemapEntry *table, int n, const unsigned char *in, int wOrg,
+             int numPixOrg, const float *lut, const float *vignetteInv,
+             float factor, float *gray, float *rgb) {
+  int i = 0;
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 scale = _mm256_set1_ps(remapWeightScale);
+  const __m256 factor8 = _mm256_set1_ps(factor);
+  const __m256i mask16 = _mm256_set1_epi32(0xffff);
+  const __m256i minusOne = _mm256_set1_epi32(-1);
+  // gathering 4 bytes per pixel reads one byte past the last one.
+  const __m256i lastSafe = _mm256_set1_epi32(numPixOrg - wOrg - 3);
+  alignas(32) float tr[8], tg[8], tb[8];
+  for (; i + 8 <= n; i += 8) {
+    __m256i offsets, weights;
+    loadRemapEntries(table + i, offsets, weights);
+    if (_mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(offsets, lastSafe)))) {
+      for (int j = i; j < i + 8; j++)
+        remapBGRPixel(table[j], in, wOrg, lut, vignetteInv, factor, gray + j,
+                      rgb + 3 * j);
+      continue;
+    }
+    __m256i valid = _mm256_cmpgt_epi32(offsets, minusOne);
+    __m256 validf = _mm256_castsi256_ps(valid);
+    offsets = _mm256_and_si256(offsets, valid);
+
+    __m256 xx = _mm256_mul_ps(
+        _mm256_cvtepi32_ps(_mm256_and_si256(weights, mask16)), scale);
+    __m256 yy =
+        _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(weights, 16)), scale);
+    __m256 xxyy = _mm256_mul_ps(xx, yy);
+    __m256 w00 =
+        _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), yy), xxyy);
+    __m256 w10 = _mm256_sub_ps(xx, xxyy);
+    __m256 w01 = _mm256_sub_ps(yy, xxyy);
+
+    __m256 irr, b, g, r;
+    __m256 sumI, sumB, sumG, sumR;
+    __m256i idx = offsets;
+    gatherBGRTap(in, idx, lut, vignetteInv, irr, b, g, r);
+    sumI = _mm256_mul_ps(w00, irr);
+    sumB = _mm256_mul_ps(w00, b);
+    sumG = _mm256_mul_ps(w00, g);
+    sumR = _mm256_mul_ps(w00, r);
+
+    idx = _mm256_add_epi32(offsets, _mm256_set1_epi32(1));
+    gatherBGRTap(in, idx, lut, vignetteInv, irr, b, g, r);
+    sumI = _mm256_add_ps(sumI, _mm256_mul_ps(w10, irr));
+    sumB = _mm256_add_ps(sumB, _mm256_mul_ps(w10, b));
+    sumG = _mm256_add_ps(sumG, _mm256_mul_ps(w10, g));
+    sumR = _mm256_add_ps(sumR, _mm256_mul_ps(w10, r));
+
+    idx = _mm256_add_epi32(offsets, _mm256_set1_epi32(wOrg));
+    gatherBGRTap(in, idx, lut, vignetteInv, irr, b, g, r);
+    sumI = _mm256_add_ps(sumI, _mm256_mul_ps(w01, irr));
+    sumB = _mm256_add_ps(sumB, _mm256_mul_ps(w01, b));
+    sumG = _mm256_add_ps(sumG, _mm256_mul_ps(w01, g));
+    sumR = _mm256_add_ps(sumR, _mm256_mul_ps(w01, r));
+
+    idx = _mm256_add_epi32(offsets, _mm256_set1_epi32(wOrg + 1));
+    gatherBGRTap(in, idx, lut, vignetteInv, irr, b, g, r);
+    sumI = _mm256_add_ps(sumI, _mm256_mul_ps(xxyy, irr));
+    sumB = _mm256_add_ps(sumB, _mm256_mul_ps(xxyy, b));
+    sumG = _mm256_add_ps(sumG, _mm256_mul_ps(xxyy, g));
+    sumR = _mm256_add_ps(sumR, _mm256_mul_ps(xxyy, r));
+
+    _mm256_storeu_ps(gray + i, _mm256_and_ps(sumI, validf));
+    _mm256_store_ps(tr, _mm256_and_ps(_mm256_mul_ps(sumR, factor8), validf));
+    _mm256_store_ps(tg, _mm256_and_ps(_mm256_mul_ps(sumG, factor8), validf));
+    _mm256_store_ps(tb, _mm256_and_ps(_mm256_mul_ps(sumB, factor8), validf));
+    float *dst = rgb + 3 * i;
+    for (int j = 0; j < 8; j++) {
+      dst[3 * j] = tr[j];
+      dst[3 * j + 1] = tg[j];
+      dst[3 * j + 2] = tb[j];
+    }
+  }
+  return i;
+}
+
+} // namespace avx2
+} // namespace dso
+
+#endif
@@ -120,6 +120,7 @@ float setting_affineOptModeA = 1e12; //-1: fix. >=0: optimize (with prior, if >
 float setting_affineOptModeB = 1e8; //-1: fix. >=0: optimize (with prior, if > 0).
 
 int setting_gammaWeightsPixelSelect = 1; // 1 = use original intensity for pixel selection; 0 = use gamma-corrected intensity.
+int setting_pyramidLayout = 0; // frame pyramids besides (I,dx,dy) per pixel: 0 = none; 1 = planar I, dx, dy; 2 = (I,dx,dy,0) per pixel.
 
 
 
@@ -166,6 +167,12 @@ float setting_trace_minImprovementFactor = 2;		// if pixel-interval is smaller t
 
 
 
+/* settings controlling the depth network */
+int setting_depthBatchSize = 1;				// max. number of queued frames pushed through the network in one forward pass.
+int setting_depthRecordQueue = 8;			// savedepth=: max. number of frames waiting to be recorded, tracking waits beyond that.
+
+
+
 
 // for benchmarking different undistortion settings
 float benchmarkSetting_fxfyfac = 0;
@@ -118,6 +118,7 @@ extern bool setting_useExposure;
 extern float setting_affineOptModeA;
 extern float setting_affineOptModeB;
 extern int setting_gammaWeightsPixelSelect;
+extern int setting_pyramidLayout;
 
 
 
@@ -159,6 +160,10 @@ extern float setting_trace_slackInterval;
 extern float setting_trace_minImprovementFactor;
 
 
+extern int setting_depthBatchSize;
+extern int setting_depthRecordQueue;
+
+
 extern bool setting_render_displayCoarseTrackingFull;
 extern bool setting_render_renderWindowFrames;
 extern bool setting_render_plotTrackingFull;